@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dmg/porting.h>
+
+/**
+ * Walks a ROM image from the reset and interrupt vectors and writes every
+ * block of code it can reach as a DMG_AOT_BLOCK entry. libdmg includes the
+ * result into cpu.c (see DMG_AOT_ROM) to build DMG_CPU_ENGINE_AOT.
+ *
+ * Usage: dmgaot <rom> <output header>
+ */
+
+// Only the fixed ROM mapping is precompiled, code anywhere else is interpreted
+#define ROM_SIZE 0x8000
+
+// Long straight runs (padding, NOP slides) are split into several blocks
+#define MAX_BLOCK_INSNS 64
+
+typedef struct DMGOpcode DMGOpcode;
+struct DMGOpcode {
+    const char *name;
+
+    uint8_t length;
+};
+
+static const DMGOpcode OPCODES[256] = {
+#define DMG_OP(code, name, length, ...) [code] = {name, length},
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+};
+
+static const DMGOpcode CB_OPCODES[256] = {
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) [code] = {name, length},
+#include <dmg/opcodes.h>
+};
+
+// Where dmg_cpu_run can enter ROM code without a jump we can see: the entry
+// point after the boot ROM, the RST vectors and the interrupt vectors
+static const uint16_t VECTORS[] = {
+        0x0100,
+        0x0000, 0x0008, 0x0010, 0x0018, 0x0020, 0x0028, 0x0030, 0x0038,
+        0x0040, 0x0048, 0x0050, 0x0058, 0x0060,
+};
+
+static uint8_t rom[ROM_SIZE];
+
+static bool queued[ROM_SIZE];
+
+static uint16_t worklist[ROM_SIZE];
+
+static size_t pending;
+
+static void enqueue(uint32_t address) {
+    if (address < ROM_SIZE && !queued[address]) {
+        queued[address] = true;
+        worklist[pending++] = (uint16_t) address;
+    }
+}
+
+/**
+ * Instructions after which the CPU has to look at interrupts or leave the
+ * straight line. Mirrors ends_block in cpu.c.
+ */
+static bool ends_block(uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: // STOP
+        case 0x18: // JR N
+        case 0x20: // JR NZ, N
+        case 0x28: // JR Z, N
+        case 0x30: // JR NC, N
+        case 0x38: // JR C, N
+        case 0x76: // HALT
+        case 0xC0: // RET NZ
+        case 0xC2: // JP NZ, NN
+        case 0xC3: // JP NN
+        case 0xC4: // CALL NZ, NN
+        case 0xC7: // RST $00
+        case 0xC8: // RET Z
+        case 0xC9: // RET
+        case 0xCA: // JP Z, NN
+        case 0xCC: // CALL Z, NN
+        case 0xCD: // CALL NN
+        case 0xCF: // RST $08
+        case 0xD0: // RET NC
+        case 0xD2: // JP NC, NN
+        case 0xD4: // CALL NC, NN
+        case 0xD7: // RST $10
+        case 0xD8: // RET C
+        case 0xD9: // RETI
+        case 0xDA: // JP C, NN
+        case 0xDC: // CALL C, NN
+        case 0xDF: // RST $18
+        case 0xE7: // RST $20
+        case 0xE9: // JP HL
+        case 0xEF: // RST $28
+        case 0xF3: // DI
+        case 0xF7: // RST $30
+        case 0xFB: // EI
+        case 0xFF: // RST $38
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+/**
+ * Queues the addresses execution can continue at after `opcode`
+ */
+static void follow(uint8_t opcode, uint16_t operand, uint16_t next) {
+    switch (opcode) {
+        case 0x18: // JR N
+            enqueue((uint16_t) (next + (int8_t) operand));
+            return;
+        case 0x20: // JR NZ, N
+        case 0x28: // JR Z, N
+        case 0x30: // JR NC, N
+        case 0x38: // JR C, N
+            enqueue((uint16_t) (next + (int8_t) operand));
+            enqueue(next);
+            return;
+        case 0xC3: // JP NN
+            enqueue(operand);
+            return;
+        case 0xC2: // JP NZ, NN
+        case 0xCA: // JP Z, NN
+        case 0xD2: // JP NC, NN
+        case 0xDA: // JP C, NN
+        case 0xC4: // CALL NZ, NN
+        case 0xCC: // CALL Z, NN
+        case 0xCD: // CALL NN
+        case 0xD4: // CALL NC, NN
+        case 0xDC: // CALL C, NN
+            enqueue(operand);
+            enqueue(next);
+            return;
+        case 0xC9: // RET
+        case 0xD9: // RETI
+        case 0xE9: // JP HL
+            return;
+        default:
+            break;
+    }
+    // RST, RET CC, HALT, STOP, EI, DI and blocks cut short fall through. RST
+    // vectors are roots already.
+    enqueue(next);
+}
+
+/**
+ * Emits the block starting at `start` and queues its successors. Returns
+ * false if there is no instruction there that can be precompiled.
+ */
+static bool translate(FILE *out, uint16_t start) {
+    // Blocks stop at the bank boundary like they do in the block engine. An
+    // instruction straddling it is left to the interpreter.
+    uint32_t limit = start < 0x4000 ? 0x4000 : ROM_SIZE;
+    if (start + OPCODES[rom[start]].length > limit) {
+        return false;
+    }
+    fprintf(out, "DMG_AOT_BLOCK(0x%04X,\n", start);
+    uint32_t pc = start;
+    for (size_t count = 1;; count++) {
+        uint8_t opcode = rom[pc];
+        const DMGOpcode *op = &OPCODES[opcode];
+        if (pc + op->length > limit) {
+            enqueue(pc);
+            break;
+        }
+        uint16_t next = (uint16_t) (pc + op->length);
+        uint16_t operand = 0;
+        if (opcode == 0xCB) {
+            uint8_t code = rom[pc + 1];
+            fprintf(out, "    DMG_AOT_CB_OP(0x%04X, 0x%02X) // %04X: %s\n", next, code, pc, CB_OPCODES[code].name);
+        } else {
+            if (op->length == 2) {
+                operand = rom[pc + 1];
+            } else if (op->length == 3) {
+                operand = (uint16_t) (rom[pc + 1] | (rom[pc + 2] << 8));
+            }
+            fprintf(out, "    DMG_AOT_OP(0x%04X, %u, 0x%02X, 0x%04X) // %04X: %s\n",
+                    next, op->length, opcode, operand, pc, op->name);
+        }
+        pc = next;
+        if (ends_block(opcode)) {
+            follow(opcode, operand, next);
+            break;
+        }
+        // Stop where another block starts rather than duplicating it
+        if (pc == limit || count == MAX_BLOCK_INSNS || queued[pc]) {
+            enqueue(pc);
+            break;
+        }
+    }
+    fprintf(out, ")\n");
+    return true;
+}
+
+/**
+ * FNV-1a over the precompiled part of the ROM. libdmg checks it before it
+ * uses the blocks.
+ */
+static uint32_t hash(const uint8_t *bytes, size_t size) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 16777619u;
+    }
+    return h;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: dmgaot <rom> <output header>\n");
+        return 1;
+    }
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        fprintf(stderr, "dmgaot: cannot open %s\n", argv[1]);
+        return 1;
+    }
+    // Anything shorter is not a cartridge libdmg would insert
+    size_t size = fread(rom, 1, ROM_SIZE, file);
+    fclose(file);
+    if (size != ROM_SIZE) {
+        fprintf(stderr, "dmgaot: %s is smaller than 32KB\n", argv[1]);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[2], "w");
+    if (!out) {
+        fprintf(stderr, "dmgaot: cannot write %s\n", argv[2]);
+        return 1;
+    }
+    fprintf(out, "// Generated by dmgaot from %s, do not edit\n\n", argv[1]);
+    fprintf(out, "DMG_AOT_ROM(0x%08Xu)\n\n", hash(rom, ROM_SIZE));
+
+    for (size_t i = 0; i < sizeof(VECTORS) / sizeof(VECTORS[0]); i++) {
+        enqueue(VECTORS[i]);
+    }
+    size_t blocks = 0;
+    while (pending) {
+        blocks += translate(out, worklist[--pending]);
+    }
+
+    fprintf(out, "\n#undef DMG_AOT_ROM\n#undef DMG_AOT_BLOCK\n");
+    fclose(out);
+    printf("dmgaot: %zu blocks\n", blocks);
+    return 0;
+}
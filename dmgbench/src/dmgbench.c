@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dmg/dmg.h>
+
+// Cycles in one 59.7Hz frame
+#define FRAME_CYCLES 70224
+
+/**
+ * Built-in workload used when no ROM is given: an ALU/memory loop over
+ * 0xC000-0xC0FF with a subroutine call per iteration.
+ */
+static const uint8_t WORKLOAD[] = {
+        0x31, 0xFE, 0xFF,   // 0100: LD SP, $FFFE
+        0x21, 0x00, 0xC0,   // 0103: LD HL, $C000
+        0x0E, 0x00,         // 0106: LD C, 0
+        0x7D,               // 0108: LD A, L
+        0x86,               // 0109: ADD (HL)
+        0xA8,               // 010A: XOR B
+        0xCB, 0x37,         // 010B: SWAP A
+        0x77,               // 010D: LD (HL), A
+        0x23,               // 010E: INC HL
+        0x04,               // 010F: INC B
+        0xCD, 0x20, 0x01,   // 0110: CALL $0120
+        0x0D,               // 0113: DEC C
+        0x20, 0xF2,         // 0114: JR NZ, $0108
+        0x18, 0xEB,         // 0116: JR $0103
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xFE, 0x10,         // 0120: CP $10
+        0x30, 0x01,         // 0122: JR NC, $0125
+        0x3C,               // 0124: INC A
+        0xC9,               // 0125: RET
+};
+
+// The switch engine comes first, every other row is checked against it
+static const struct {
+    const char *name;
+    DMGCpuEngine engine;
+    bool lockstep;
+} ENGINES[] = {
+        {"switch", DMG_CPU_ENGINE_SWITCH, false},
+        {"table", DMG_CPU_ENGINE_TABLE, false},
+        {"threaded", DMG_CPU_ENGINE_THREADED, false},
+        {"block", DMG_CPU_ENGINE_BLOCK, false},
+        {"jit", DMG_CPU_ENGINE_JIT, false},
+        {"aot", DMG_CPU_ENGINE_AOT, false},
+        // Checks every native block against the interpreter
+        {"jit-check", DMG_CPU_ENGINE_JIT, true},
+};
+
+/**
+ * Where a run left the CPU. Every engine has to end up in the same place.
+ */
+typedef struct {
+    size_t cycles;
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t af;
+    uint16_t bc;
+    uint16_t de;
+    uint16_t hl;
+} Outcome;
+
+static void vblank(DMGState *state) {
+}
+
+/**
+ * Inserts the cartridge into a fresh state set up for `engine`
+ */
+static bool power_on(DMGState *state, const DMGRom *rom, bool builtin, DMGCpuEngine engine, bool lockstep) {
+    memset(state, 0, sizeof(DMGState));
+    if (!dmg_cart_insert(state, rom->data, rom->size)) {
+        return false;
+    }
+    state->cpu.ime = true;
+    state->cpu.engine = engine;
+    state->jit.lockstep = lockstep;
+    if (builtin) {
+        // The built-in workload has no header for the boot ROM to check, so start past it
+        state->mmu.io[DMG_IO_BIOS] = 0x01;
+        state->cpu.pc = 0x0100;
+    }
+    return true;
+}
+
+static Outcome outcome(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
+    dmg_cpu_flags(cpu);
+    return (Outcome) {state->cycles, cpu->pc, cpu->sp, cpu->af, cpu->bc, cpu->de, cpu->hl};
+}
+
+static bool same(const Outcome *a, const Outcome *b) {
+    return a->cycles == b->cycles && a->pc == b->pc && a->sp == b->sp && a->af == b->af && a->bc == b->bc &&
+           a->de == b->de && a->hl == b->hl;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : NULL;
+    size_t frames = argc > 2 ? (size_t) strtoul(argv[2], NULL, 10) : 3600;
+
+    DMGRom rom;
+    uint8_t *workload = NULL;
+    if (path) {
+        if (!dmg_rom_open(&rom, path)) {
+            fprintf(stderr, "dmgbench: cannot load %s\n", path);
+            return 1;
+        }
+    } else {
+        workload = calloc(1, 0x8000);
+        memcpy(workload + 0x0100, WORKLOAD, sizeof(WORKLOAD));
+        rom = (DMGRom) {workload, 0x8000, false};
+    }
+
+    DMGState *state = malloc(sizeof(DMGState));
+    if (!power_on(state, &rom, !path, DMG_CPU_ENGINE_SWITCH, false)) {
+        fprintf(stderr, "dmgbench: unsupported cartridge\n");
+        return 1;
+    }
+    // Lockstep copies the whole state for every block, so it only checks
+    // one frame in sixty. Its rows are held against a switch run that long.
+    size_t short_target = (frames + 59) / 60 * FRAME_CYCLES;
+    dmg_run(state, vblank, short_target);
+    Outcome short_reference = outcome(state);
+    dmg_cpu_free(state);
+    Outcome reference = {0};
+
+    int status = 0;
+    printf("%-10s %12s %10s %10s  %s\n", "engine", "cycles", "seconds", "x realtime", "pc/af/bc/de/hl");
+    for (size_t i = 0; i < sizeof(ENGINES) / sizeof(ENGINES[0]); i++) {
+        if (!dmg_cpu_engine_built(ENGINES[i].engine)) {
+            // It would only time, or check, the engine it falls back to
+            printf("%-10s %12s\n", ENGINES[i].name, "not built");
+            continue;
+        }
+        power_on(state, &rom, !path, ENGINES[i].engine, ENGINES[i].lockstep);
+
+        size_t target = ENGINES[i].lockstep ? short_target : frames * FRAME_CYCLES;
+        double start = now();
+        dmg_run(state, vblank, target);
+        double elapsed = now() - start;
+
+        Outcome result = outcome(state);
+        if (i == 0) {
+            reference = result;
+        }
+        bool matches = same(&result, ENGINES[i].lockstep ? &short_reference : &reference);
+        printf("%-10s %12zu %10.3f %10.1f  %04X/%04X/%04X/%04X/%04X%s\n",
+               ENGINES[i].name, result.cycles, elapsed, (result.cycles / (double) FRAME_CYCLES / 59.7) / elapsed,
+               result.pc, result.af, result.bc, result.de, result.hl, matches ? "" : "  differs from switch");
+        if (!matches) {
+            status = 1;
+        }
+        if (ENGINES[i].lockstep) {
+            printf("%-10s %zu native blocks checked, %zu mismatches\n", "", state->jit.checked, state->jit.mismatches);
+            if (state->jit.mismatches) {
+                status = 1;
+            }
+        }
+        dmg_cpu_free(state);
+    }
+
+    free(state);
+    if (workload) {
+        free(workload);
+    } else {
+        dmg_rom_close(&rom);
+    }
+    return status;
+}
@@ -50,36 +50,40 @@ int main() {
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, 160, 144);
 
-    FILE *file = fopen("drmario.gb", "rb");
-    fseek(file, 0, SEEK_END);
-    size_t size = (size_t)ftell(file);
-    rewind(file);
-    uint8_t *rom = malloc(size);
-    fread(rom, 1, size, file);
-    fclose(file);
+    DMGRom rom;
+    if (!dmg_rom_open(&rom, "drmario.gb")) {
+        fprintf(stderr, "dmgdb: cannot load drmario.gb\n");
+        return 1;
+    }
 
     DMGState *state = calloc(1, sizeof(DMGState));
     state->cpu.ime = true;
-    state->rom = rom;
+    if (!dmg_cart_insert(state, rom.data, rom.size)) {
+        fprintf(stderr, "dmgdb: unsupported cartridge\n");
+        return 1;
+    }
+    DMGSave save = {0};
+    if (state->cart.has_battery && dmg_save_open(&save, "drmario.sav", dmg_cart_ram_size(state))) {
+        dmg_cart_attach_save(state, &save);
+    }
 
     SDL_Thread *debugger_thread = SDL_CreateThread(debugger, "Debugger", NULL);
 
-    while (true) {
+    bool running = true;
+    while (running) {
         SDL_Event event;
-        SDL_PollEvent(&event);
-        if (event.type == SDL_QUIT) {
-            break;
-        }
-        size_t cycles = state->cycles;
-        dmg_cpu_run(state, 0);
-        cycles = state->cycles - cycles;
-        while(cycles--) {
-            dmg_ppu_run(state, vblank, 0);
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                running = false;
+            }
         }
+        // One frame's worth of cycles between polls
+        dmg_run(state, vblank, 70224);
     }
 
     free(state);
-    free(rom);
+    dmg_save_close(&save);
+    dmg_rom_close(&rom);
 
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
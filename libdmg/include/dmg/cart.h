@@ -0,0 +1,190 @@
+#ifndef DMG_CART_H
+#define DMG_CART_H
+
+#include <dmg/porting.h>
+#include <dmg/save.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGState DMGState;
+
+typedef enum DMGCartType DMGCartType;
+
+/**
+ * Memory bank controllers, selected from the cartridge type at 0x0147
+ */
+enum DMGCartType {
+    /**
+     * 32KB of ROM and at most 8KB of RAM, writes to ROM are ignored
+     */
+    DMG_CART_ROM,
+
+    /**
+     * Up to 2MB of ROM and 32KB of RAM
+     */
+    DMG_CART_MBC1,
+
+    /**
+     * Up to 2MB of ROM, 32KB of RAM and an optional real time clock
+     */
+    DMG_CART_MBC3,
+
+    /**
+     * Up to 8MB of ROM and 128KB of RAM
+     */
+    DMG_CART_MBC5,
+};
+
+typedef enum DMGRtcRegister DMGRtcRegister;
+
+/**
+ * MBC3 clock registers, selected by writing 0x08-0x0C to 0x4000-0x5FFF
+ */
+enum DMGRtcRegister {
+    DMG_RTC_S,
+    DMG_RTC_M,
+    DMG_RTC_H,
+    DMG_RTC_DL,
+    DMG_RTC_DH,
+
+    DMG_RTC_COUNT,
+};
+
+typedef struct DMGRtc DMGRtc;
+
+/**
+ * MBC3 real time clock. It counts emulated rather than host time, so runs
+ * are reproducible, and only catches up when the game looks at it.
+ */
+struct DMGRtc {
+    /**
+     * Running counter, DH holds day bit 8, halt (0x40) and day carry (0x80)
+     */
+    uint8_t live[DMG_RTC_COUNT];
+
+    /**
+     * Copy of `live` the game reads, taken on a 0 then 1 write to 0x6000
+     */
+    uint8_t latched[DMG_RTC_COUNT];
+
+    /**
+     * Last byte written to 0x6000-0x7FFF
+     */
+    uint8_t latch;
+
+    /**
+     * Cycle `live` was last brought up to date at
+     */
+    uint64_t synced;
+};
+
+typedef struct DMGCart DMGCart;
+
+struct DMGCart {
+    DMGCartType type;
+
+    bool has_rtc;
+
+    bool has_battery;
+
+    /**
+     * Bank counts, both powers of two (or no RAM) so selecting a bank is a
+     * mask and never reaches past the end of the image
+     */
+    uint16_t rom_banks;
+
+    uint8_t ram_banks;
+
+    /**
+     * Offsets into a RAM bank are masked with this: 0x07FF for 2KB RAM, which
+     * repeats across 0xA000-0xBFFF, 0x1FFF otherwise
+     */
+    uint16_t ram_mask;
+
+    /**
+     * Bank registers as last written. MBC1 splits the ROM bank between
+     * `rom_bank` (bits 0-4) and `bank_high` (bits 5-6), which selects the
+     * RAM bank instead in `mode` 1. On MBC3 `ram_bank` 0x08-0x0C maps an RTC
+     * register instead of RAM.
+     */
+    uint16_t rom_bank;
+
+    uint8_t bank_high;
+
+    uint8_t ram_bank;
+
+    uint8_t mode;
+
+    bool ram_enabled;
+
+    /**
+     * Banks currently mapped at 0x0000-0x3FFF and 0x4000-0x7FFF, and their
+     * base in the ROM image. Recomputed only when a bank register is written.
+     */
+    uint16_t bank0;
+
+    uint16_t bankx;
+
+    const uint8_t *rom0;
+
+    const uint8_t *romx;
+
+    DMGRtc rtc;
+
+    /**
+     * Battery save the RAM lives in instead of `DMGMmu::cram`, or NULL
+     */
+    DMGSave *save;
+
+    /**
+     * Set when the game disables RAM after enabling it, so dmg_run flushes
+     * the save once the CPU stops
+     */
+    bool save_pending;
+};
+
+/**
+ * Inserts the `size` byte cartridge image `rom`, choosing the bank controller
+ * from its header. Returns false if the image is shorter than 32KB or the
+ * controller is not supported. The image must outlive the state.
+ */
+bool dmg_cart_insert(DMGState *state, const uint8_t *rom, size_t size);
+
+/**
+ * Bytes of RAM on the inserted cartridge, the size its save file needs
+ */
+size_t dmg_cart_ram_size(DMGState *state);
+
+/**
+ * Moves the cartridge RAM into `save`, whose contents become the RAM. The
+ * game then writes straight into the save and nothing copies it on the
+ * emulation thread. Returns false if the cartridge has no battery or `save`
+ * is too small for its RAM. The save must stay open while attached.
+ */
+bool dmg_cart_attach_save(DMGState *state, DMGSave *save);
+
+/**
+ * Handles a write to 0x0000-0x7FFF, which goes to the bank controller
+ */
+void dmg_cart_write(DMGState *state, uint16_t address, uint8_t byte);
+
+/**
+ * Reads 0xA000-0xBFFF while it is not mapped to RAM: an RTC register, or
+ * 0xFF with RAM disabled or absent
+ */
+uint8_t dmg_cart_read_ram(DMGState *state, uint16_t address);
+
+/**
+ * Writes 0xA000-0xBFFF while it is not mapped to RAM
+ */
+void dmg_cart_write_ram(DMGState *state, uint16_t address, uint8_t byte);
+
+/**
+ * Selected RAM bank, in `DMGMmu::cram` or the save, or NULL while 0xA000-0xBFFF is not
+ * plain RAM
+ */
+uint8_t *dmg_cart_ram(DMGState *state);
+
+DMG_EXTERN_END
+
+#endif // DMG_CART_H
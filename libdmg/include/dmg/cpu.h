@@ -7,6 +7,63 @@ DMG_EXTERN_BEGIN
 
 typedef struct DMGState DMGState;
 
+typedef enum DMGCpuEngine DMGCpuEngine;
+
+enum DMGCpuEngine {
+    /**
+     * Whichever engine the library was configured with (DMG_CPU_ENGINE)
+     */
+    DMG_CPU_ENGINE_DEFAULT,
+
+    /**
+     * Reference interpreter, a single switch per instruction
+     */
+    DMG_CPU_ENGINE_SWITCH,
+
+    /**
+     * Handler function-pointer table, portable to any compiler
+     */
+    DMG_CPU_ENGINE_TABLE,
+
+    /**
+     * Computed-goto threaded code. Falls back to the table on compilers
+     * without labels-as-values
+     */
+    DMG_CPU_ENGINE_THREADED,
+
+    /**
+     * Predecoded basic blocks replayed from DMGBlockCache
+     */
+    DMG_CPU_ENGINE_BLOCK,
+
+    /**
+     * Hot blocks translated to native x86-64 code. Falls back to the block
+     * engine when the library is built without DMG_JIT
+     */
+    DMG_CPU_ENGINE_JIT,
+
+    /**
+     * Blocks precompiled to C by dmgaot for the ROM libdmg was configured
+     * with (DMG_AOT_ROM). Anything else, including other ROMs, runs on the
+     * block engine
+     */
+    DMG_CPU_ENGINE_AOT,
+};
+
+typedef enum DMGFlagsOp DMGFlagsOp;
+
+/**
+ * Last flag-setting operation whose flags have not been folded into `f` yet
+ */
+enum DMGFlagsOp {
+    DMG_FLAGS_NONE,
+    DMG_FLAGS_ADD,
+    DMG_FLAGS_SUB,
+    DMG_FLAGS_INC,
+    DMG_FLAGS_DEC,
+    DMG_FLAGS_ADD16,
+};
+
 typedef struct DMGCpu DMGCpu;
 struct DMGCpu {
 
@@ -50,16 +107,244 @@ struct DMGCpu {
         uint16_t hl;
     };
 
+    /**
+     * Deferred flags (DMG_LAZY_FLAGS). While `flags_op` is not DMG_FLAGS_NONE
+     * the bits it defines in `f` are stale; use dmg_cpu_flags to read them.
+     */
+    uint8_t flags_op;
+
+    uint16_t flags_lhs;
+
+    uint16_t flags_rhs;
+
+    uint32_t flags_result;
+
     bool halted;
 
-    uint8_t halt_flags;
+    /**
+     * HALT ran with IME clear and an interrupt already pending, so the CPU
+     * carried on but will fetch the next opcode without advancing PC past it
+     */
+    bool halt_bug;
 
     bool stopped;
 
     bool ime;
+
+    /**
+     * EI ran and IME turns on once the instruction after it has
+     */
+    bool ei;
+
+    /**
+     * Whether anything has to happen before the next instruction: the CPU is
+     * halted, an EI or the HALT bug is in flight, or IME is set and an
+     * interrupt is pending. Kept up to date by dmg_irq_update.
+     */
+    bool irq;
+
+    DMGCpuEngine engine;
+};
+
+typedef struct DMGInsn DMGInsn;
+
+typedef void (*DMGInsnHandler)(DMGState *state, const DMGInsn *insn);
+
+/**
+ * A predecoded instruction. `cycles` is the static cost of fetching it, the
+ * handler charges whatever the instruction itself takes on top.
+ */
+struct DMGInsn {
+    DMGInsnHandler handler;
+
+    uint16_t operand;
+
+    uint8_t cycles;
+
+    uint8_t length;
+
+    uint8_t opcode;
+};
+
+#define DMG_BLOCK_INSNS 16
+
+#define DMG_BLOCK_VALID 0x80000000u
+// ROM blocks use their bank number, 0x000-0x1FF
+#define DMG_BLOCK_BANK_WRAM 0x200
+#define DMG_BLOCK_BANK_HRAM 0x210
+#define DMG_BLOCK_BANK_BIOS 0x211
+
+typedef struct DMGBlock DMGBlock;
+
+/**
+ * A straight-line run of instructions ending at the first control transfer
+ */
+struct DMGBlock {
+    /**
+     * DMG_BLOCK_VALID | bank << 16 | start, or 0 when the slot is empty
+     */
+    uint32_t key;
+
+    uint16_t start;
+
+    uint16_t end;
+
+    uint8_t count;
+
+    /**
+     * Nothing but reads and register ops looping back to the start, e.g. a
+     * poll of LY. Iterations that change nothing are skipped.
+     */
+    bool idle;
+
+    /**
+     * Times the block was entered before being translated (DMG_CPU_ENGINE_JIT)
+     */
+    uint16_t hits;
+
+    /**
+     * Upper bound on the cycles the native code takes, it only runs when the
+     * whole block fits in the budget
+     */
+    uint16_t native_cycles;
+
+    /**
+     * Translated code, or NULL
+     */
+    void *native;
+
+    /**
+     * Cache slots of the blocks that last ran after this one, falling
+     * through (0) or branching (1). Only trusted while DMGBlockCache::epoch
+     * still equals `link_epochs`.
+     */
+    uint16_t links[2];
+
+    uint32_t link_epochs[2];
+
+    DMGInsn insns[DMG_BLOCK_INSNS];
 };
 
-void dmg_cpu_run(DMGState *state, size_t cycles);
+#define DMG_BLOCK_CACHE_BITS 10
+#define DMG_BLOCK_CACHE_SIZE (1 << DMG_BLOCK_CACHE_BITS)
+
+// Granularity at which writes to RAM are checked against cached code
+#define DMG_BLOCK_LINE_BITS 6
+
+// Lines from 0x8000 up, the only ones blocks are tracked in
+#define DMG_BLOCK_RAM_LINES (0x8000 >> DMG_BLOCK_LINE_BITS)
+
+// Blocks listed per RAM line, past that a write to the line searches the
+// whole cache
+#define DMG_BLOCK_LINE_SLOTS 8
+
+typedef struct DMGBlockCache DMGBlockCache;
+
+/**
+ * Direct-mapped cache of decoded blocks keyed on (bank, pc)
+ */
+struct DMGBlockCache {
+    DMGBlock blocks[DMG_BLOCK_CACHE_SIZE];
+
+    /**
+     * RAM lines that cached blocks were decoded from
+     */
+    bool code[0x10000 >> DMG_BLOCK_LINE_BITS];
+
+    /**
+     * Cache slots of the blocks decoded from each RAM line, so that a write
+     * only looks at those. Entries go stale when their slot is reused and are
+     * rechecked when used. A count past DMG_BLOCK_LINE_SLOTS means the line
+     * has more blocks than fit.
+     */
+    uint16_t line_slots[DMG_BLOCK_RAM_LINES][DMG_BLOCK_LINE_SLOTS];
+
+    uint8_t line_counts[DMG_BLOCK_RAM_LINES];
+
+    /**
+     * Set when the running block may have gone stale, or an interrupt may have
+     * become pending, so the engine has to stop replaying it
+     */
+    bool dirty;
+
+    /**
+     * Bumped whenever a block is dropped or replaced or the banks code can
+     * run from change, which is when links between blocks go stale
+     */
+    uint32_t epoch;
+
+    /**
+     * ROM last checked against the precompiled blocks (DMG_CPU_ENGINE_AOT),
+     * and whether it matched
+     */
+    const uint8_t *aot_rom;
+
+    bool aot_match;
+};
+
+typedef struct DMGJit DMGJit;
+
+/**
+ * Native code buffer for DMG_CPU_ENGINE_JIT, mapped on first use
+ */
+struct DMGJit {
+    uint8_t *code;
+
+    size_t size;
+
+    size_t used;
+
+    /**
+     * Runs every native block against the interpreter on a copy of the state
+     * and compares the results. On a mismatch the interpreter's result wins.
+     */
+    bool lockstep;
+
+    size_t checked;
+
+    size_t mismatches;
+
+    /**
+     * Scratch state the lockstep interpreter runs on
+     */
+    DMGState *shadow;
+};
+
+/**
+ * Executes instructions until at least `cycles` cycles have elapsed, the CPU
+ * halts or an event is posted before then. Returns the number of cycles
+ * actually consumed, which may overshoot the budget by part of an instruction.
+ */
+size_t dmg_cpu_run(DMGState *state, size_t cycles);
+
+/**
+ * Whether `engine` is built into the library, rather than falling back to
+ * another one when asked for
+ */
+bool dmg_cpu_engine_built(DMGCpuEngine engine);
+
+/**
+ * Folds any deferred flags into `f` and returns it. Anything reading `f` or
+ * `af` from outside the CPU (debuggers, save states) must call this first.
+ */
+uint8_t dmg_cpu_flags(DMGCpu *cpu);
+
+/**
+ * Drops cached blocks holding the byte at `address`. The MMU calls this when
+ * a RAM line cached code came from is written.
+ */
+void dmg_cpu_invalidate(DMGState *state, uint16_t address);
+
+/**
+ * Drops every cached block decoded from RAM, for when all of it changes at
+ * once. Blocks from ROM and the boot ROM stay.
+ */
+void dmg_cpu_invalidate_ram(DMGState *state);
+
+/**
+ * Releases memory the CPU engines allocated on demand. The state stays usable.
+ */
+void dmg_cpu_free(DMGState *state);
 
 DMG_EXTERN_END
 
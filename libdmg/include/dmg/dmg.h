@@ -2,12 +2,54 @@
 #define DMG_H
 
 #include <dmg/porting.h>
+#include <dmg/cart.h>
 #include <dmg/cpu.h>
+#include <dmg/irq.h>
 #include <dmg/mmu.h>
 #include <dmg/ppu.h>
+#include <dmg/rom.h>
+#include <dmg/save.h>
+#include <dmg/sched.h>
 #include <dmg/state.h>
+#include <dmg/timer.h>
 
 DMG_EXTERN_BEGIN
+
+typedef enum DMGResetMode DMGResetMode;
+
+enum DMGResetMode {
+    /**
+     * Power on into the boot ROM, which checks the header and scrolls the
+     * logo for about a quarter of a second. A zeroed DMGState starts here too.
+     */
+    DMG_RESET_BIOS,
+
+    /**
+     * Start at 0x0100 in the state the DMG boot ROM hands over in
+     */
+    DMG_RESET_DMG,
+
+    /**
+     * Start at 0x0100 in the state the CGB boot ROM hands a color game over
+     * in. Games tell a CGB apart by A being 0x11.
+     */
+    DMG_RESET_CGB,
+};
+
+/**
+ * Turns the machine off and on again. The cartridge stays inserted with its
+ * save attached and the CPU engine and cached ROM code are kept, everything
+ * else, including cartridge RAM without a battery, starts over.
+ */
+void dmg_reset(DMGState *state, DMGResetMode mode);
+
+/**
+ * Runs the machine for at least `cycles` cycles. The CPU runs uninterrupted
+ * up to the next scheduled event, which is then dispatched. `vblank` is
+ * called whenever a frame is complete. A battery save the game finished
+ * writing is flushed before returning. Returns the number of cycles run.
+ */
+size_t dmg_run(DMGState *state, DMGVBlankCallback vblank, size_t cycles);
 DMG_EXTERN_END
 
 #endif // DMG_H
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef DMG_IRQ_H
+#define DMG_IRQ_H
+
+#include <dmg/porting.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGState DMGState;
+
+typedef enum DMGInterrupt DMGInterrupt;
+
+/**
+ * Request bits in IF and IE, lowest first in priority
+ */
+enum DMGInterrupt {
+    DMG_INT_VBLANK = 0x01,
+    DMG_INT_STAT = 0x02,
+    DMG_INT_TIMER = 0x04,
+    DMG_INT_SERIAL = 0x08,
+    DMG_INT_JOYPAD = 0x10,
+};
+
+/**
+ * Interrupts both requested and enabled, whether or not IME lets them through.
+ * These are what wake the CPU from HALT.
+ */
+uint8_t dmg_irq_pending(DMGState *state);
+
+/**
+ * Requests the interrupts in `bits`
+ */
+void dmg_irq_raise(DMGState *state, uint8_t bits);
+
+/**
+ * Recomputes state->cpu.irq. Anything changing IF, IE, IME, a pending EI or
+ * the HALT state calls this, so the CPU only has to test the one flag before
+ * each instruction.
+ */
+void dmg_irq_update(DMGState *state);
+
+DMG_EXTERN_END
+
+#endif // DMG_IRQ_H
@@ -16,9 +16,11 @@ struct DMGMmu {
     uint8_t vram[2][8192]; // 8KB
 
     /**
-     * 0xA000-0xBFFF Optional cart extension RAM
+     * 0xA000-0xBFFF Optional cart extension RAM, banked by the cartridge's
+     * controller. Unused while a battery save is attached, the RAM lives in
+     * the save then.
      */
-    uint8_t cram[8192]; // 8KB
+    uint8_t cram[16 * 8192]; // 128KB
 
     /**
      * 0xC000-0xCFFF Onboard Working RAM
@@ -44,6 +46,38 @@ struct DMGMmu {
      * 0xFF80-0xFFFE HI RAM
      */
     uint8_t hram[128];
+
+    /**
+     * Set while an OAM DMA holds the bus, until DMG_EVENT_DMA. OAM reads as
+     * 0xFF and ignores writes meanwhile.
+     */
+    bool dma;
+
+    /**
+     * CGB HDMA: where the next 16 byte block comes from and goes to (an
+     * offset into the selected VRAM bank), and how many blocks are left.
+     * While `hdma_hblank` is set one block is copied each HBlank.
+     */
+    uint16_t hdma_source;
+
+    uint16_t hdma_dest;
+
+    uint8_t hdma_blocks;
+
+    bool hdma_hblank;
+};
+
+typedef struct DMGPageTable DMGPageTable;
+
+/**
+ * Host pointers to each 256 byte page of the address space. NULL pages go
+ * through the MMU's handlers: IO, OAM, the boot ROM, writes to ROM and VRAM,
+ * and plain memory that has not been accessed since its bank changed.
+ */
+struct DMGPageTable {
+    const uint8_t *read[256];
+
+    uint8_t *write[256];
 };
 
 typedef enum DMGIOPort DMGIOPort;
@@ -56,10 +90,10 @@ enum DMGIOPort {
     DMG_IO_JOYP =  0x00,
     DMG_IO_SB =    0x01,
     DMG_IO_SC =    0x02,
-    DMG_IO_DIV =   0x03,
-    DMG_IO_TIMA =  0x04,
-    DMG_IO_TMA =   0x05,
-    DMG_IO_TAC =   0x06,
+    DMG_IO_DIV =   0x04,
+    DMG_IO_TIMA =  0x05,
+    DMG_IO_TMA =   0x06,
+    DMG_IO_TAC =   0x07,
     DMG_IO_KEY1 =  0x4D,
     DMG_IO_RP =    0x56,
 
@@ -147,8 +181,46 @@ enum DMGIOPort {
 
 uint8_t dmg_mmu_read(DMGState *state, uint16_t address);
 
+/**
+ * dmg_mmu_read for an address on a page the page table does not map, for
+ * callers that already looked it up there
+ */
+uint8_t dmg_mmu_read_slow(DMGState *state, uint16_t address);
+
 void dmg_mmu_write(DMGState *state, uint16_t address, uint8_t byte);
 
+/**
+ * Ends the OAM DMA. Dispatched by the scheduler (DMG_EVENT_DMA).
+ */
+void dmg_mmu_dma_event(DMGState *state);
+
+/**
+ * Copies the next block of an HBlank DMA. Called by the PPU as it enters
+ * HBlank while `hdma_hblank` is set.
+ */
+void dmg_mmu_hdma_hblank(DMGState *state);
+
+/**
+ * Points the pages from `start` to `end` at the consecutive host memory at
+ * `memory` for reading, or drops them when it is NULL so they are mapped
+ * again on their next access. Writes always go through the handlers.
+ */
+void dmg_mmu_map(DMGState *state, uint16_t start, uint16_t end, const uint8_t *memory);
+
+/**
+ * Leaves IO, the timer and VRAM as the boot ROM does when it jumps to the
+ * cartridge at 0x0100 on a DMG, or a CGB running a color game, with the boot
+ * ROM switched off and the LCD on. Expects the rest of the machine to be in
+ * its power on state, see dmg_reset.
+ */
+void dmg_mmu_skip_bios(DMGState *state, bool cgb);
+
+/**
+ * Drops every page mapping. Call after changing `rom` or a bank register
+ * behind the MMU's back, e.g. when restoring a saved state.
+ */
+void dmg_mmu_unmap(DMGState *state);
+
 DMG_EXTERN_END
 
 #endif // DMG_MMU_H
\ No newline at end of file
@@ -20,8 +20,6 @@
 #define __has_attribute(...) 0
 #endif
 
-#define DMG_INLINE
-
 #ifndef DMG_INLINE
 #if __has_attribute(always_inline)
 #define DMG_INLINE inline __attribute__((always_inline))
@@ -30,4 +28,11 @@
 #endif
 #endif
 
+// Labels-as-values, used by the threaded CPU engine
+#ifdef __GNUC__
+#define DMG_HAS_COMPUTED_GOTO 1
+#else
+#define DMG_HAS_COMPUTED_GOTO 0
+#endif
+
 #endif // DMG_PORTING_H
\ No newline at end of file
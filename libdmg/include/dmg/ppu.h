@@ -7,18 +7,128 @@ DMG_EXTERN_BEGIN
 
 typedef struct DMGState DMGState;
 
+typedef void (*DMGVBlankCallback)(struct DMGState *state);
+
 typedef struct DMGPpu DMGPpu;
 
 struct DMGPpu {
-    bool stat_raised;
-    bool vblank_raised;
-    int32_t timer;
+    /**
+     * Mode shown in the low bits of STAT: 0 HBlank, 1 VBlank, 2 OAM scan,
+     * 3 drawing. 4 is the first line after the LCD is switched on, before
+     * drawing, and shows as 0.
+     */
+    uint8_t mode;
+
+    /**
+     * Cycle the current mode ends at. Mode changes are applied lazily, only
+     * when something could observe them (dmg_ppu_sync) or they raise an
+     * interrupt (DMG_EVENT_PPU).
+     */
+    uint64_t next;
+
+    /**
+     * Called when LY reaches 144 and `lcd` holds a complete frame
+     */
+    DMGVBlankCallback vblank;
+
+    /**
+     * Window line drawn next. Only counts lines the window was shown on, so
+     * hiding it part way down the frame does not skip any of its rows.
+     */
+    uint8_t window_line;
+
     uint32_t lcd[23040];
 };
 
-typedef void (*DMGVBlankCallback)(struct DMGState *state);
+#define DMG_PPU_TILES 384
+
+typedef struct DMGTileCache DMGTileCache;
+
+/**
+ * The tiles in each VRAM bank decoded to one colour number per pixel, row by
+ * row. A tile is decoded when it is first drawn after VRAM under it changed,
+ * so most lines only copy pixels out.
+ */
+struct DMGTileCache {
+    uint8_t pixels[2][DMG_PPU_TILES][64];
+
+    /**
+     * Whether `pixels` matches VRAM, cleared by dmg_ppu_invalidate
+     */
+    bool valid[2][DMG_PPU_TILES];
+};
+
+// Sprites a line can show, the rest are dropped
+#define DMG_PPU_LINE_SPRITES 10
+
+typedef struct DMGSpriteIndex DMGSpriteIndex;
+
+/**
+ * OAM sorted out by line: the first 10 sprites in OAM order on each line,
+ * lowest X first and OAM order among equal X, which is the order they win in
+ * where they overlap. Rebuilt on the first line drawn after OAM or the sprite
+ * size changed rather than searched on every line.
+ */
+struct DMGSpriteIndex {
+    /**
+     * Offset in OAM of each line's sprites
+     */
+    uint8_t sprites[144][DMG_PPU_LINE_SPRITES];
+
+    uint8_t count[144];
+
+    /**
+     * Whether the index matches OAM, cleared by dmg_ppu_invalidate_oam
+     */
+    bool valid;
+
+    /**
+     * Whether it was built for 8x16 sprites
+     */
+    bool tall;
+};
+
+/**
+ * Applies every mode change due by state->cycles, rendering lines as they
+ * finish. Anything that reads state the PPU writes (LY, STAT, `lcd`) or
+ * writes state it reads (VRAM, OAM, LCD registers) must call this first.
+ */
+void dmg_ppu_sync(DMGState *state);
+
+/**
+ * Catches up at `when`, the next mode change that raises an interrupt or
+ * copies an HBlank DMA block.
+ * Dispatched by the scheduler (DMG_EVENT_PPU).
+ */
+void dmg_ppu_event(DMGState *state, uint64_t when);
+
+/**
+ * Recomputes when the PPU next raises an interrupt after STAT or LYC changed
+ */
+void dmg_ppu_reschedule(DMGState *state);
+
+/**
+ * Starts or stops the PPU after LCDC bit 7 changed
+ */
+void dmg_ppu_lcd_switched(DMGState *state);
+
+/**
+ * Drops the decoded tiles that overlap the `length` bytes at `offset` in VRAM
+ * bank `bank`. The MMU calls this for every write that changes tile data.
+ */
+void dmg_ppu_invalidate(DMGState *state, uint8_t bank, uint16_t offset, uint16_t length);
+
+/**
+ * Drops the sprite index. The MMU calls this for every write that changes
+ * OAM, including OAM DMA.
+ */
+void dmg_ppu_invalidate_oam(DMGState *state);
 
-void dmg_ppu_run(DMGState *state, DMGVBlankCallback vblank, size_t cycles);
+/**
+ * Drops every decoded tile and the sprite index, for when VRAM or OAM changed
+ * behind the MMU's back
+ */
+void dmg_ppu_invalidate_all(DMGState *state);
 
 DMG_EXTERN_END
 
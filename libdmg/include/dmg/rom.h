@@ -0,0 +1,48 @@
+#ifndef DMG_ROM_H
+#define DMG_ROM_H
+
+#include <dmg/porting.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGRom DMGRom;
+
+/**
+ * A cartridge image loaded read-only. Any number of states can insert the
+ * same image, from any thread: nothing in libdmg ever writes to it.
+ */
+struct DMGRom {
+    const uint8_t *data;
+
+    size_t size;
+
+    /**
+     * Whether `data` maps the file, in which case every process mapping the
+     * same file shares its pages (including across fork), or is a private
+     * copy on platforms without mmap
+     */
+    bool mapped;
+};
+
+/**
+ * Loads the image at `path` into `rom`, mapping the file where the platform
+ * allows rather than copying it. Returns false if the file cannot be read or
+ * fails dmg_rom_valid, leaving `rom` empty.
+ */
+bool dmg_rom_open(DMGRom *rom, const char *path);
+
+/**
+ * Releases an image from dmg_rom_open. No state may still have it inserted.
+ */
+void dmg_rom_close(DMGRom *rom);
+
+/**
+ * Checks the cartridge header: the image is at least 32KB, the header
+ * checksum at 0x014D matches and the ROM size at 0x0148 is one the image is
+ * large enough to hold
+ */
+bool dmg_rom_valid(const uint8_t *data, size_t size);
+
+DMG_EXTERN_END
+
+#endif // DMG_ROM_H
@@ -0,0 +1,51 @@
+#ifndef DMG_SAVE_H
+#define DMG_SAVE_H
+
+#include <dmg/porting.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGSave DMGSave;
+
+/**
+ * A battery save file the cartridge RAM lives in, see dmg_cart_attach_save
+ */
+struct DMGSave {
+    uint8_t *data;
+
+    size_t size;
+
+    /**
+     * Whether `data` maps the file. Mapped saves reach the page cache as the
+     * game writes them, so they survive the process exiting or crashing and
+     * flushing only starts writeback early. Otherwise `data` is a copy that
+     * is written back to `path` on every flush.
+     */
+    bool mapped;
+
+    char *path;
+};
+
+/**
+ * Opens the save file at `path`, creating it or growing it with zeroes to
+ * `size` bytes, and maps it read-write. Returns false if it cannot be
+ * created or mapped, leaving `save` empty.
+ */
+bool dmg_save_open(DMGSave *save, const char *path, size_t size);
+
+/**
+ * Hands what the game wrote since the last flush to the OS without waiting
+ * for the disk. dmg_run calls this after the game disables cartridge RAM,
+ * which is how games finish a save.
+ */
+void dmg_save_flush(DMGSave *save);
+
+/**
+ * Writes the save out, waiting for the disk, and releases it. No state may
+ * still have it attached.
+ */
+void dmg_save_close(DMGSave *save);
+
+DMG_EXTERN_END
+
+#endif // DMG_SAVE_H
@@ -0,0 +1,93 @@
+#ifndef DMG_SCHED_H
+#define DMG_SCHED_H
+
+#include <dmg/porting.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGState DMGState;
+
+typedef enum DMGEventType DMGEventType;
+
+/**
+ * Things that happen at a fixed point in emulated time. Each type has at most
+ * one pending event, posting it again moves it.
+ */
+enum DMGEventType {
+    /**
+     * PPU mode change that raises an interrupt (VBlank, STAT) or starts an
+     * HBlank with an HBlank DMA running. The ones in between are caught up
+     * lazily, see dmg_ppu_sync.
+     */
+    DMG_EVENT_PPU,
+
+    /**
+     * End of the 160 M-cycles an OAM DMA holds the bus for
+     */
+    DMG_EVENT_DMA,
+
+    /**
+     * TIMA overflow, see DMGTimer
+     */
+    DMG_EVENT_TIMER,
+
+    DMG_EVENT_COUNT,
+};
+
+// Every event type is pending at most once, so this bounds the heap
+#define DMG_SCHED_CAPACITY 8
+
+typedef struct DMGScheduler DMGScheduler;
+
+/**
+ * Min-heap of pending events keyed on the absolute cycle they are due at
+ */
+struct DMGScheduler {
+    /**
+     * Cycle the CPU is currently allowed to run to. Posting an event before
+     * it pulls it in, so the CPU stops in time to dispatch it.
+     */
+    uint64_t deadline;
+
+    /**
+     * Due cycle of each event type, only meaningful while it is in the heap
+     */
+    uint64_t when[DMG_EVENT_COUNT];
+
+    /**
+     * Pending event types ordered by `when`
+     */
+    uint8_t heap[DMG_SCHED_CAPACITY];
+
+    /**
+     * Position of each event type in `heap`
+     */
+    uint8_t index[DMG_EVENT_COUNT];
+
+    uint8_t size;
+};
+
+/**
+ * Schedules `type` to be dispatched once state->cycles reaches `when`,
+ * replacing any pending event of the same type
+ */
+void dmg_sched_post(DMGState *state, DMGEventType type, uint64_t when);
+
+/**
+ * Drops the pending event of `type`, if any
+ */
+void dmg_sched_cancel(DMGState *state, DMGEventType type);
+
+/**
+ * Cycle the earliest pending event is due at, UINT64_MAX if there is none
+ */
+uint64_t dmg_sched_next(DMGState *state);
+
+/**
+ * Dispatches every event that is due at the current cycle, in order
+ */
+void dmg_sched_dispatch(DMGState *state);
+
+DMG_EXTERN_END
+
+#endif // DMG_SCHED_H
@@ -2,20 +2,34 @@
 #define DMG_STATE_H
 
 #include <dmg/porting.h>
+#include <dmg/cart.h>
 #include <dmg/cpu.h>
 #include <dmg/mmu.h>
 #include <dmg/ppu.h>
+#include <dmg/sched.h>
+#include <dmg/timer.h>
 
 DMG_EXTERN_BEGIN
 
 typedef struct DMGState DMGState;
 struct DMGState {
-    uint8_t *rom;
+    const uint8_t *rom;
+    size_t rom_size;
     size_t cycles;
 
     DMGCpu cpu;
     DMGMmu mmu;
+    DMGCart cart;
     DMGPpu ppu;
+    DMGTimer timer;
+    DMGScheduler sched;
+
+    // Caches derived from the state above, keep them last
+    DMGBlockCache blocks;
+    DMGJit jit;
+    DMGPageTable pages;
+    DMGTileCache tiles;
+    DMGSpriteIndex sprites;
 };
 
 DMG_EXTERN_END
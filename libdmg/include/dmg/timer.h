@@ -0,0 +1,59 @@
+#ifndef DMG_TIMER_H
+#define DMG_TIMER_H
+
+#include <dmg/porting.h>
+
+DMG_EXTERN_BEGIN
+
+typedef struct DMGState DMGState;
+
+typedef struct DMGTimer DMGTimer;
+
+/**
+ * DIV and TIMA are never ticked. DIV is worked out from the cycle counter
+ * when read, TIMA is caught up when read or written, and its overflow is a
+ * scheduled event (DMG_EVENT_TIMER).
+ */
+struct DMGTimer {
+    /**
+     * Cycle the 16 bit divider was last reset at, DIV is its upper byte
+     */
+    uint64_t div_base;
+
+    /**
+     * Cycle `io[DMG_IO_TIMA]` was last brought up to date at
+     */
+    uint64_t synced;
+};
+
+/**
+ * Current value of DIV
+ */
+uint8_t dmg_timer_div(DMGState *state);
+
+/**
+ * Applies the TIMA increments due by state->cycles, reloading it from TMA and
+ * raising the timer interrupt if it overflowed
+ */
+void dmg_timer_sync(DMGState *state);
+
+/**
+ * Catches up at a TIMA overflow. Dispatched by the scheduler
+ * (DMG_EVENT_TIMER).
+ */
+void dmg_timer_event(DMGState *state);
+
+/**
+ * Handles a write to DIV, TIMA, TMA or TAC
+ */
+void dmg_timer_write(DMGState *state, uint8_t port, uint8_t byte);
+
+/**
+ * First cycle after state->cycles at which reading DIV or TIMA (`port`)
+ * gives a different value, UINT64_MAX if it cannot change
+ */
+uint64_t dmg_timer_next_change(DMGState *state, uint8_t port);
+
+DMG_EXTERN_END
+
+#endif // DMG_TIMER_H
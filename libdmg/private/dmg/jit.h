@@ -0,0 +1,29 @@
+#ifndef DMG_JIT_H
+#define DMG_JIT_H
+
+#include <dmg/state.h>
+
+/**
+ * Entry point of a translated block. Runs the block against `state` and
+ * returns how many of its instructions were executed.
+ */
+typedef uint32_t (*DMGNativeBlock)(DMGState *state);
+
+/**
+ * Blocks are translated once they have been entered this many times
+ */
+#define DMG_JIT_THRESHOLD 16
+
+/**
+ * Translates `block` into native code and stores it in `block->native`.
+ * Blocks that have to stay interpreted (IO access, code in RAM) are left
+ * without native code.
+ */
+void dmg_jit_compile(DMGState *state, DMGBlock *block);
+
+/**
+ * Drops every translated block and unmaps the code buffer
+ */
+void dmg_jit_free(DMGState *state);
+
+#endif // DMG_JIT_H
@@ -0,0 +1,534 @@
+/**
+ * SM83 opcode table.
+ *
+ * Every CPU engine in cpu.c stamps out its dispatch from this one list, so an
+ * instruction's semantics only ever live here. Before including, define:
+ *
+ *   DMG_OP(opcode, mnemonic, length, body)     a base opcode
+ *   DMG_CB_OP(opcode, mnemonic, length, body)  an opcode following the 0xCB prefix
+ *
+ * `length` is the encoded size in bytes, prefix included. Bodies run with
+ * `state` and `cpu` in scope and fetch their operand through DMG_IMM8() or
+ * DMG_IMM16(), which the including engine also defines, so an engine that
+ * predecodes instructions can hand them over without touching memory.
+ * DMG_DISPATCH_CB(opcode) continues into the prefixed table. DMG_OP and
+ * DMG_CB_OP are undefined again at the end of this file so it can be included
+ * repeatedly.
+ */
+
+DMG_OP(0x00, "NOP", 1, { })
+DMG_OP(0x01, "LD BC, NN", 3, { cpu->bc = DMG_IMM16(); })
+DMG_OP(0x02, "LD (BC), A", 1, { write8(state, cpu->bc, cpu->a); })
+DMG_OP(0x03, "INC BC", 1, { inc_rr(state, &cpu->bc); })
+DMG_OP(0x04, "INC B", 1, { inc_r(state, &cpu->b); })
+DMG_OP(0x05, "DEC B", 1, { dec_r(state, &cpu->b); })
+DMG_OP(0x06, "LD B, N", 2, { cpu->b = DMG_IMM8(); })
+DMG_OP(0x07, "RLCA", 1, { rlca(state); })
+DMG_OP(0x08, "LD (NN), SP", 3, { write16(state, DMG_IMM16(), cpu->sp); })
+DMG_OP(0x09, "ADD HL, BC", 1, { add_hl_rr(state, &cpu->bc); })
+DMG_OP(0x0A, "LD A, (BC)", 1, { cpu->a = read8(state, cpu->bc); })
+DMG_OP(0x0B, "DEC BC", 1, { dec_rr(state, &cpu->bc); })
+DMG_OP(0x0C, "INC C", 1, { inc_r(state, &cpu->c); })
+DMG_OP(0x0D, "DEC C", 1, { dec_r(state, &cpu->c); })
+DMG_OP(0x0E, "LD C, N", 2, { cpu->c = DMG_IMM8(); })
+DMG_OP(0x0F, "RRCA", 1, { rrca(state); })
+DMG_OP(0x10, "STOP", 2, { (void) DMG_IMM8(); stop(state); })
+DMG_OP(0x11, "LD DE, NN", 3, { cpu->de = DMG_IMM16(); })
+DMG_OP(0x12, "LD (DE), A", 1, { write8(state, cpu->de, cpu->a); })
+DMG_OP(0x13, "INC DE", 1, { inc_rr(state, &cpu->de); })
+DMG_OP(0x14, "INC D", 1, { inc_r(state, &cpu->d); })
+DMG_OP(0x15, "DEC D", 1, { dec_r(state, &cpu->d); })
+DMG_OP(0x16, "LD D, N", 2, { cpu->d = DMG_IMM8(); })
+DMG_OP(0x17, "RLA", 1, { rla(state); })
+DMG_OP(0x18, "JR N", 2, { jr_n(state, DMG_IMM8()); })
+DMG_OP(0x19, "ADD HL, DE", 1, { add_hl_rr(state, &cpu->de); })
+DMG_OP(0x1A, "LD A, (DE)", 1, { cpu->a = read8(state, cpu->de); })
+DMG_OP(0x1B, "DEC DE", 1, { dec_rr(state, &cpu->de); })
+DMG_OP(0x1C, "INC E", 1, { inc_r(state, &cpu->e); })
+DMG_OP(0x1D, "DEC E", 1, { dec_r(state, &cpu->e); })
+DMG_OP(0x1E, "LD E, N", 2, { cpu->e = DMG_IMM8(); })
+DMG_OP(0x1F, "RRA", 1, { rra(state); })
+DMG_OP(0x20, "JR NZ, N", 2, { jr_nz_n(state, DMG_IMM8()); })
+DMG_OP(0x21, "LD HL, NN", 3, { cpu->hl = DMG_IMM16(); })
+DMG_OP(0x22, "LDI (HL), A", 1, { ldi_hl_a(state); })
+DMG_OP(0x23, "INC HL", 1, { inc_rr(state, &cpu->hl); })
+DMG_OP(0x24, "INC H", 1, { inc_r(state, &cpu->h); })
+DMG_OP(0x25, "DEC H", 1, { dec_r(state, &cpu->h); })
+DMG_OP(0x26, "LD H, N", 2, { cpu->h = DMG_IMM8(); })
+DMG_OP(0x27, "DAA", 1, { daa(state); })
+DMG_OP(0x28, "JR Z, N", 2, { jr_z_n(state, DMG_IMM8()); })
+DMG_OP(0x29, "ADD HL, HL", 1, { add_hl_rr(state, &cpu->hl); })
+DMG_OP(0x2A, "LDI A, (HL)", 1, { ldi_a_hl(state); })
+DMG_OP(0x2B, "DEC HL", 1, { dec_rr(state, &cpu->hl); })
+DMG_OP(0x2C, "INC L", 1, { inc_r(state, &cpu->l); })
+DMG_OP(0x2D, "DEC L", 1, { dec_r(state, &cpu->l); })
+DMG_OP(0x2E, "LD L, N", 2, { cpu->l = DMG_IMM8(); })
+DMG_OP(0x2F, "CPL", 1, { cpl(state); })
+DMG_OP(0x30, "JR NC, N", 2, { jr_nc_n(state, DMG_IMM8()); })
+DMG_OP(0x31, "LD SP, NN", 3, { cpu->sp = DMG_IMM16(); })
+DMG_OP(0x32, "LDD (HL), A", 1, { ldd_hl_a(state); })
+DMG_OP(0x33, "INC SP", 1, { inc_rr(state, &cpu->sp); })
+DMG_OP(0x34, "INC (HL)", 1, { inc_mem_hl(state); })
+DMG_OP(0x35, "DEC (HL)", 1, { dec_mem_hl(state); })
+DMG_OP(0x36, "LD (HL), N", 2, { write8(state, cpu->hl, DMG_IMM8()); })
+DMG_OP(0x37, "SCF", 1, { scf(state); })
+DMG_OP(0x38, "JR C, N", 2, { jr_c_n(state, DMG_IMM8()); })
+DMG_OP(0x39, "ADD HL, SP", 1, { add_hl_rr(state, &cpu->sp); })
+DMG_OP(0x3A, "LDD A, (HL)", 1, { ldd_a_hl(state); })
+DMG_OP(0x3B, "DEC SP", 1, { dec_rr(state, &cpu->sp); })
+DMG_OP(0x3C, "INC A", 1, { inc_r(state, &cpu->a); })
+DMG_OP(0x3D, "DEC A", 1, { dec_r(state, &cpu->a); })
+DMG_OP(0x3E, "LD A, N", 2, { cpu->a = DMG_IMM8(); })
+DMG_OP(0x3F, "CCF", 1, { ccf(state); })
+DMG_OP(0x40, "LD B, B", 1, { cpu->b = cpu->b; })
+DMG_OP(0x41, "LD B, C", 1, { cpu->b = cpu->c; })
+DMG_OP(0x42, "LD B, D", 1, { cpu->b = cpu->d; })
+DMG_OP(0x43, "LD B, E", 1, { cpu->b = cpu->e; })
+DMG_OP(0x44, "LD B, H", 1, { cpu->b = cpu->h; })
+DMG_OP(0x45, "LD B, L", 1, { cpu->b = cpu->l; })
+DMG_OP(0x46, "LD B, (HL)", 1, { cpu->b = read8(state, cpu->hl); })
+DMG_OP(0x47, "LD B, A", 1, { cpu->b = cpu->a; })
+DMG_OP(0x48, "LD C, B", 1, { cpu->c = cpu->b; })
+DMG_OP(0x49, "LD C, C", 1, { cpu->c = cpu->c; })
+DMG_OP(0x4A, "LD C, D", 1, { cpu->c = cpu->d; })
+DMG_OP(0x4B, "LD C, E", 1, { cpu->c = cpu->e; })
+DMG_OP(0x4C, "LD C, H", 1, { cpu->c = cpu->h; })
+DMG_OP(0x4D, "LD C, L", 1, { cpu->c = cpu->l; })
+DMG_OP(0x4E, "LD C, (HL)", 1, { cpu->c = read8(state, cpu->hl); })
+DMG_OP(0x4F, "LD C, A", 1, { cpu->c = cpu->a; })
+DMG_OP(0x50, "LD D, B", 1, { cpu->d = cpu->b; })
+DMG_OP(0x51, "LD D, C", 1, { cpu->d = cpu->c; })
+DMG_OP(0x52, "LD D, D", 1, { cpu->d = cpu->d; })
+DMG_OP(0x53, "LD D, E", 1, { cpu->d = cpu->e; })
+DMG_OP(0x54, "LD D, H", 1, { cpu->d = cpu->h; })
+DMG_OP(0x55, "LD D, L", 1, { cpu->d = cpu->l; })
+DMG_OP(0x56, "LD D, (HL)", 1, { cpu->d = read8(state, cpu->hl); })
+DMG_OP(0x57, "LD D, A", 1, { cpu->d = cpu->a; })
+DMG_OP(0x58, "LD E, B", 1, { cpu->e = cpu->b; })
+DMG_OP(0x59, "LD E, C", 1, { cpu->e = cpu->c; })
+DMG_OP(0x5A, "LD E, D", 1, { cpu->e = cpu->d; })
+DMG_OP(0x5B, "LD E, E", 1, { cpu->e = cpu->e; })
+DMG_OP(0x5C, "LD E, H", 1, { cpu->e = cpu->h; })
+DMG_OP(0x5D, "LD E, L", 1, { cpu->e = cpu->l; })
+DMG_OP(0x5E, "LD E, (HL)", 1, { cpu->e = read8(state, cpu->hl); })
+DMG_OP(0x5F, "LD E, A", 1, { cpu->e = cpu->a; })
+DMG_OP(0x60, "LD H, B", 1, { cpu->h = cpu->b; })
+DMG_OP(0x61, "LD H, C", 1, { cpu->h = cpu->c; })
+DMG_OP(0x62, "LD H, D", 1, { cpu->h = cpu->d; })
+DMG_OP(0x63, "LD H, E", 1, { cpu->h = cpu->e; })
+DMG_OP(0x64, "LD H, H", 1, { cpu->h = cpu->h; })
+DMG_OP(0x65, "LD H, L", 1, { cpu->h = cpu->l; })
+DMG_OP(0x66, "LD H, (HL)", 1, { cpu->h = read8(state, cpu->hl); })
+DMG_OP(0x67, "LD H, A", 1, { cpu->h = cpu->a; })
+DMG_OP(0x68, "LD L, B", 1, { cpu->l = cpu->b; })
+DMG_OP(0x69, "LD L, C", 1, { cpu->l = cpu->c; })
+DMG_OP(0x6A, "LD L, D", 1, { cpu->l = cpu->d; })
+DMG_OP(0x6B, "LD L, E", 1, { cpu->l = cpu->e; })
+DMG_OP(0x6C, "LD L, H", 1, { cpu->l = cpu->h; })
+DMG_OP(0x6D, "LD L, L", 1, { cpu->l = cpu->l; })
+DMG_OP(0x6E, "LD L, (HL)", 1, { cpu->l = read8(state, cpu->hl); })
+DMG_OP(0x6F, "LD L, A", 1, { cpu->l = cpu->a; })
+DMG_OP(0x70, "LD (HL), B", 1, { write8(state, cpu->hl, cpu->b); })
+DMG_OP(0x71, "LD (HL), C", 1, { write8(state, cpu->hl, cpu->c); })
+DMG_OP(0x72, "LD (HL), D", 1, { write8(state, cpu->hl, cpu->d); })
+DMG_OP(0x73, "LD (HL), E", 1, { write8(state, cpu->hl, cpu->e); })
+DMG_OP(0x74, "LD (HL), H", 1, { write8(state, cpu->hl, cpu->h); })
+DMG_OP(0x75, "LD (HL), L", 1, { write8(state, cpu->hl, cpu->l); })
+DMG_OP(0x76, "HALT", 1, { halt(state); })
+DMG_OP(0x77, "LD (HL), A", 1, { write8(state, cpu->hl, cpu->a); })
+DMG_OP(0x78, "LD A, B", 1, { cpu->a = cpu->b; })
+DMG_OP(0x79, "LD A, C", 1, { cpu->a = cpu->c; })
+DMG_OP(0x7A, "LD A, D", 1, { cpu->a = cpu->d; })
+DMG_OP(0x7B, "LD A, E", 1, { cpu->a = cpu->e; })
+DMG_OP(0x7C, "LD A, H", 1, { cpu->a = cpu->h; })
+DMG_OP(0x7D, "LD A, L", 1, { cpu->a = cpu->l; })
+DMG_OP(0x7E, "LD A, (HL)", 1, { cpu->a = read8(state, cpu->hl); })
+DMG_OP(0x7F, "LD A, A", 1, { cpu->a = cpu->a; })
+DMG_OP(0x80, "ADD B", 1, { add_r(state, cpu->b); })
+DMG_OP(0x81, "ADD C", 1, { add_r(state, cpu->c); })
+DMG_OP(0x82, "ADD D", 1, { add_r(state, cpu->d); })
+DMG_OP(0x83, "ADD E", 1, { add_r(state, cpu->e); })
+DMG_OP(0x84, "ADD H", 1, { add_r(state, cpu->h); })
+DMG_OP(0x85, "ADD L", 1, { add_r(state, cpu->l); })
+DMG_OP(0x86, "ADD (HL)", 1, { add_r(state, read8(state, cpu->hl)); })
+DMG_OP(0x87, "ADD A", 1, { add_r(state, cpu->a); })
+DMG_OP(0x88, "ADC B", 1, { adc_r(state, cpu->b); })
+DMG_OP(0x89, "ADC C", 1, { adc_r(state, cpu->c); })
+DMG_OP(0x8A, "ADC D", 1, { adc_r(state, cpu->d); })
+DMG_OP(0x8B, "ADC E", 1, { adc_r(state, cpu->e); })
+DMG_OP(0x8C, "ADC H", 1, { adc_r(state, cpu->h); })
+DMG_OP(0x8D, "ADC L", 1, { adc_r(state, cpu->l); })
+DMG_OP(0x8E, "ADC (HL)", 1, { adc_r(state, read8(state, cpu->hl)); })
+DMG_OP(0x8F, "ADC A", 1, { adc_r(state, cpu->a); })
+DMG_OP(0x90, "SUB B", 1, { sub_r(state, cpu->b); })
+DMG_OP(0x91, "SUB C", 1, { sub_r(state, cpu->c); })
+DMG_OP(0x92, "SUB D", 1, { sub_r(state, cpu->d); })
+DMG_OP(0x93, "SUB E", 1, { sub_r(state, cpu->e); })
+DMG_OP(0x94, "SUB H", 1, { sub_r(state, cpu->h); })
+DMG_OP(0x95, "SUB L", 1, { sub_r(state, cpu->l); })
+DMG_OP(0x96, "SUB (HL)", 1, { sub_r(state, read8(state, cpu->hl)); })
+DMG_OP(0x97, "SUB A", 1, { sub_r(state, cpu->a); })
+DMG_OP(0x98, "SBC B", 1, { sbc_r(state, cpu->b); })
+DMG_OP(0x99, "SBC C", 1, { sbc_r(state, cpu->c); })
+DMG_OP(0x9A, "SBC D", 1, { sbc_r(state, cpu->d); })
+DMG_OP(0x9B, "SBC E", 1, { sbc_r(state, cpu->e); })
+DMG_OP(0x9C, "SBC H", 1, { sbc_r(state, cpu->h); })
+DMG_OP(0x9D, "SBC L", 1, { sbc_r(state, cpu->l); })
+DMG_OP(0x9E, "SBC (HL)", 1, { sbc_r(state, read8(state, cpu->hl)); })
+DMG_OP(0x9F, "SBC A", 1, { sbc_r(state, cpu->a); })
+DMG_OP(0xA0, "AND B", 1, { and_r(state, cpu->b); })
+DMG_OP(0xA1, "AND C", 1, { and_r(state, cpu->c); })
+DMG_OP(0xA2, "AND D", 1, { and_r(state, cpu->d); })
+DMG_OP(0xA3, "AND E", 1, { and_r(state, cpu->e); })
+DMG_OP(0xA4, "AND H", 1, { and_r(state, cpu->h); })
+DMG_OP(0xA5, "AND L", 1, { and_r(state, cpu->l); })
+DMG_OP(0xA6, "AND (HL)", 1, { and_r(state, read8(state, cpu->hl)); })
+DMG_OP(0xA7, "AND A", 1, { and_r(state, cpu->a); })
+DMG_OP(0xA8, "XOR B", 1, { xor_r(state, cpu->b); })
+DMG_OP(0xA9, "XOR C", 1, { xor_r(state, cpu->c); })
+DMG_OP(0xAA, "XOR D", 1, { xor_r(state, cpu->d); })
+DMG_OP(0xAB, "XOR E", 1, { xor_r(state, cpu->e); })
+DMG_OP(0xAC, "XOR H", 1, { xor_r(state, cpu->h); })
+DMG_OP(0xAD, "XOR L", 1, { xor_r(state, cpu->l); })
+DMG_OP(0xAE, "XOR (HL)", 1, { xor_r(state, read8(state, cpu->hl)); })
+DMG_OP(0xAF, "XOR A", 1, { xor_r(state, cpu->a); })
+DMG_OP(0xB0, "OR B", 1, { or_r(state, cpu->b); })
+DMG_OP(0xB1, "OR C", 1, { or_r(state, cpu->c); })
+DMG_OP(0xB2, "OR D", 1, { or_r(state, cpu->d); })
+DMG_OP(0xB3, "OR E", 1, { or_r(state, cpu->e); })
+DMG_OP(0xB4, "OR H", 1, { or_r(state, cpu->h); })
+DMG_OP(0xB5, "OR L", 1, { or_r(state, cpu->l); })
+DMG_OP(0xB6, "OR (HL)", 1, { or_r(state, read8(state, cpu->hl)); })
+DMG_OP(0xB7, "OR A", 1, { or_r(state, cpu->a); })
+DMG_OP(0xB8, "CP B", 1, { cp_r(state, cpu->b); })
+DMG_OP(0xB9, "CP C", 1, { cp_r(state, cpu->c); })
+DMG_OP(0xBA, "CP D", 1, { cp_r(state, cpu->d); })
+DMG_OP(0xBB, "CP E", 1, { cp_r(state, cpu->e); })
+DMG_OP(0xBC, "CP H", 1, { cp_r(state, cpu->h); })
+DMG_OP(0xBD, "CP L", 1, { cp_r(state, cpu->l); })
+DMG_OP(0xBE, "CP (HL)", 1, { cp_r(state, read8(state, cpu->hl)); })
+DMG_OP(0xBF, "CP A", 1, { cp_r(state, cpu->a); })
+DMG_OP(0xC0, "RET NZ", 1, { ret_nz(state); })
+DMG_OP(0xC1, "POP BC", 1, { cpu->bc = pop16(state); })
+DMG_OP(0xC2, "JP NZ, NN", 3, { jp_nz(state, DMG_IMM16()); })
+DMG_OP(0xC3, "JP NN", 3, { jp_nn(state, DMG_IMM16()); })
+DMG_OP(0xC4, "CALL NZ, NN", 3, { call_nz(state, DMG_IMM16()); })
+DMG_OP(0xC5, "PUSH BC", 1, { push16(state, cpu->bc); })
+DMG_OP(0xC6, "ADD N", 2, { add_r(state, DMG_IMM8()); })
+DMG_OP(0xC7, "RST $00", 1, { rst(state, 0x00); })
+DMG_OP(0xC8, "RET Z", 1, { ret_z(state); })
+DMG_OP(0xC9, "RET", 1, { ret(state); })
+DMG_OP(0xCA, "JP Z, NN", 3, { jp_z(state, DMG_IMM16()); })
+DMG_OP(0xCB, "CB-PREFIX", 2, { DMG_DISPATCH_CB(read8_pc(state)); })
+DMG_OP(0xCC, "CALL Z, NN", 3, { call_z(state, DMG_IMM16()); })
+DMG_OP(0xCD, "CALL NN", 3, { call_nn(state, DMG_IMM16()); })
+DMG_OP(0xCE, "ADC N", 2, { adc_r(state, DMG_IMM8()); })
+DMG_OP(0xCF, "RST $08", 1, { rst(state, 0x08); })
+DMG_OP(0xD0, "RET NC", 1, { ret_nc(state); })
+DMG_OP(0xD1, "POP DE", 1, { cpu->de = pop16(state); })
+DMG_OP(0xD2, "JP NC, NN", 3, { jp_nc(state, DMG_IMM16()); })
+DMG_OP(0xD3, "INVALID", 1, { })
+DMG_OP(0xD4, "CALL NC, NN", 3, { call_nc(state, DMG_IMM16()); })
+DMG_OP(0xD5, "PUSH DE", 1, { push16(state, cpu->de); })
+DMG_OP(0xD6, "SUB N", 2, { sub_r(state, DMG_IMM8()); })
+DMG_OP(0xD7, "RST $10", 1, { rst(state, 0x10); })
+DMG_OP(0xD8, "RET C", 1, { ret_c(state); })
+DMG_OP(0xD9, "RETI", 1, { reti(state); })
+DMG_OP(0xDA, "JP C, NN", 3, { jp_c(state, DMG_IMM16()); })
+DMG_OP(0xDB, "INVALID", 1, { })
+DMG_OP(0xDC, "CALL C, NN", 3, { call_c(state, DMG_IMM16()); })
+DMG_OP(0xDD, "INVALID", 1, { })
+DMG_OP(0xDE, "SBC N", 2, { sbc_r(state, DMG_IMM8()); })
+DMG_OP(0xDF, "RST $18", 1, { rst(state, 0x18); })
+DMG_OP(0xE0, "LDH (N), A", 2, { write8(state, (uint16_t) (0xFF00 + DMG_IMM8()), cpu->a); })
+DMG_OP(0xE1, "POP HL", 1, { cpu->hl = pop16(state); })
+DMG_OP(0xE2, "LDH (C), A", 1, { write8(state, (uint16_t) (0xFF00 + cpu->c), cpu->a); })
+DMG_OP(0xE3, "INVALID", 1, { })
+DMG_OP(0xE4, "INVALID", 1, { })
+DMG_OP(0xE5, "PUSH HL", 1, { push16(state, cpu->hl); })
+DMG_OP(0xE6, "AND N", 2, { and_r(state, DMG_IMM8()); })
+DMG_OP(0xE7, "RST $20", 1, { rst(state, 0x20); })
+DMG_OP(0xE8, "ADD SP, N", 2, { add_sp_n(state, DMG_IMM8()); })
+DMG_OP(0xE9, "JP HL", 1, { cpu->pc = cpu->hl; })
+DMG_OP(0xEA, "LD (NN), A", 3, { write8(state, DMG_IMM16(), cpu->a); })
+DMG_OP(0xEB, "INVALID", 1, { })
+DMG_OP(0xEC, "INVALID", 1, { })
+DMG_OP(0xED, "INVALID", 1, { })
+DMG_OP(0xEE, "XOR N", 2, { xor_r(state, DMG_IMM8()); })
+DMG_OP(0xEF, "RST $28", 1, { rst(state, 0x28); })
+DMG_OP(0xF0, "LDH A, (N)", 2, { cpu->a = read8(state, (uint16_t) (0xFF00 + DMG_IMM8())); })
+DMG_OP(0xF1, "POP AF", 1, { cpu->af = (uint16_t) (pop16(state) & 0xFFF0); cpu->flags_op = DMG_FLAGS_NONE; })
+DMG_OP(0xF2, "LDH A, (C)", 1, { cpu->a = read8(state, (uint16_t) (0xFF00 + cpu->c)); })
+DMG_OP(0xF3, "DI", 1, { di(state); })
+DMG_OP(0xF4, "INVALID", 1, { })
+DMG_OP(0xF5, "PUSH AF", 1, { dmg_cpu_flags(cpu); push16(state, (uint16_t) (cpu->af & 0xFFF0)); })
+DMG_OP(0xF6, "OR N", 2, { or_r(state, DMG_IMM8()); })
+DMG_OP(0xF7, "RST $30", 1, { rst(state, 0x30); })
+DMG_OP(0xF8, "LDHL SP, N", 2, { ldhl_sp_n(state, DMG_IMM8()); })
+DMG_OP(0xF9, "LD SP, HL", 1, { ld_sp_hl(state); })
+DMG_OP(0xFA, "LD A, (NN)", 3, { cpu->a = read8(state, DMG_IMM16()); })
+DMG_OP(0xFB, "EI", 1, { ei(state); })
+DMG_OP(0xFC, "INVALID", 1, { })
+DMG_OP(0xFD, "INVALID", 1, { })
+DMG_OP(0xFE, "CP N", 2, { cp_r(state, DMG_IMM8()); })
+DMG_OP(0xFF, "RST $38", 1, { rst(state, 0x38); })
+
+DMG_CB_OP(0x00, "RLC B", 2, { rlc_r(state, &cpu->b); })
+DMG_CB_OP(0x01, "RLC C", 2, { rlc_r(state, &cpu->c); })
+DMG_CB_OP(0x02, "RLC D", 2, { rlc_r(state, &cpu->d); })
+DMG_CB_OP(0x03, "RLC E", 2, { rlc_r(state, &cpu->e); })
+DMG_CB_OP(0x04, "RLC H", 2, { rlc_r(state, &cpu->h); })
+DMG_CB_OP(0x05, "RLC L", 2, { rlc_r(state, &cpu->l); })
+DMG_CB_OP(0x06, "RLC (HL)", 2, { rlc_mem_hl(state); })
+DMG_CB_OP(0x07, "RLC A", 2, { rlc_r(state, &cpu->a); })
+DMG_CB_OP(0x08, "RRC B", 2, { rrc_r(state, &cpu->b); })
+DMG_CB_OP(0x09, "RRC C", 2, { rrc_r(state, &cpu->c); })
+DMG_CB_OP(0x0A, "RRC D", 2, { rrc_r(state, &cpu->d); })
+DMG_CB_OP(0x0B, "RRC E", 2, { rrc_r(state, &cpu->e); })
+DMG_CB_OP(0x0C, "RRC H", 2, { rrc_r(state, &cpu->h); })
+DMG_CB_OP(0x0D, "RRC L", 2, { rrc_r(state, &cpu->l); })
+DMG_CB_OP(0x0E, "RRC (HL)", 2, { rrc_mem_hl(state); })
+DMG_CB_OP(0x0F, "RRC A", 2, { rrc_r(state, &cpu->a); })
+DMG_CB_OP(0x10, "RL B", 2, { rl_r(state, &cpu->b); })
+DMG_CB_OP(0x11, "RL C", 2, { rl_r(state, &cpu->c); })
+DMG_CB_OP(0x12, "RL D", 2, { rl_r(state, &cpu->d); })
+DMG_CB_OP(0x13, "RL E", 2, { rl_r(state, &cpu->e); })
+DMG_CB_OP(0x14, "RL H", 2, { rl_r(state, &cpu->h); })
+DMG_CB_OP(0x15, "RL L", 2, { rl_r(state, &cpu->l); })
+DMG_CB_OP(0x16, "RL (HL)", 2, { rl_mem_hl(state); })
+DMG_CB_OP(0x17, "RL A", 2, { rl_r(state, &cpu->a); })
+DMG_CB_OP(0x18, "RR B", 2, { rr_r(state, &cpu->b); })
+DMG_CB_OP(0x19, "RR C", 2, { rr_r(state, &cpu->c); })
+DMG_CB_OP(0x1A, "RR D", 2, { rr_r(state, &cpu->d); })
+DMG_CB_OP(0x1B, "RR E", 2, { rr_r(state, &cpu->e); })
+DMG_CB_OP(0x1C, "RR H", 2, { rr_r(state, &cpu->h); })
+DMG_CB_OP(0x1D, "RR L", 2, { rr_r(state, &cpu->l); })
+DMG_CB_OP(0x1E, "RR (HL)", 2, { rr_mem_hl(state); })
+DMG_CB_OP(0x1F, "RR A", 2, { rr_r(state, &cpu->a); })
+DMG_CB_OP(0x20, "SLA B", 2, { sla_r(state, &cpu->b); })
+DMG_CB_OP(0x21, "SLA C", 2, { sla_r(state, &cpu->c); })
+DMG_CB_OP(0x22, "SLA D", 2, { sla_r(state, &cpu->d); })
+DMG_CB_OP(0x23, "SLA E", 2, { sla_r(state, &cpu->e); })
+DMG_CB_OP(0x24, "SLA H", 2, { sla_r(state, &cpu->h); })
+DMG_CB_OP(0x25, "SLA L", 2, { sla_r(state, &cpu->l); })
+DMG_CB_OP(0x26, "SLA (HL)", 2, { sla_mem_hl(state); })
+DMG_CB_OP(0x27, "SLA A", 2, { sla_r(state, &cpu->a); })
+DMG_CB_OP(0x28, "SRA B", 2, { sra_r(state, &cpu->b); })
+DMG_CB_OP(0x29, "SRA C", 2, { sra_r(state, &cpu->c); })
+DMG_CB_OP(0x2A, "SRA D", 2, { sra_r(state, &cpu->d); })
+DMG_CB_OP(0x2B, "SRA E", 2, { sra_r(state, &cpu->e); })
+DMG_CB_OP(0x2C, "SRA H", 2, { sra_r(state, &cpu->h); })
+DMG_CB_OP(0x2D, "SRA L", 2, { sra_r(state, &cpu->l); })
+DMG_CB_OP(0x2E, "SRA (HL)", 2, { sra_mem_hl(state); })
+DMG_CB_OP(0x2F, "SRA A", 2, { sra_r(state, &cpu->a); })
+DMG_CB_OP(0x30, "SWAP B", 2, { swap_r(state, &cpu->b); })
+DMG_CB_OP(0x31, "SWAP C", 2, { swap_r(state, &cpu->c); })
+DMG_CB_OP(0x32, "SWAP D", 2, { swap_r(state, &cpu->d); })
+DMG_CB_OP(0x33, "SWAP E", 2, { swap_r(state, &cpu->e); })
+DMG_CB_OP(0x34, "SWAP H", 2, { swap_r(state, &cpu->h); })
+DMG_CB_OP(0x35, "SWAP L", 2, { swap_r(state, &cpu->l); })
+DMG_CB_OP(0x36, "SWAP (HL)", 2, { swap_mem_hl(state); })
+DMG_CB_OP(0x37, "SWAP A", 2, { swap_r(state, &cpu->a); })
+DMG_CB_OP(0x38, "SRL B", 2, { srl_r(state, &cpu->b); })
+DMG_CB_OP(0x39, "SRL C", 2, { srl_r(state, &cpu->c); })
+DMG_CB_OP(0x3A, "SRL D", 2, { srl_r(state, &cpu->d); })
+DMG_CB_OP(0x3B, "SRL E", 2, { srl_r(state, &cpu->e); })
+DMG_CB_OP(0x3C, "SRL H", 2, { srl_r(state, &cpu->h); })
+DMG_CB_OP(0x3D, "SRL L", 2, { srl_r(state, &cpu->l); })
+DMG_CB_OP(0x3E, "SRL (HL)", 2, { srl_mem_hl(state); })
+DMG_CB_OP(0x3F, "SRL A", 2, { srl_r(state, &cpu->a); })
+DMG_CB_OP(0x40, "BIT 0, B", 2, { bit_r(state, cpu->b, 0); })
+DMG_CB_OP(0x41, "BIT 0, C", 2, { bit_r(state, cpu->c, 0); })
+DMG_CB_OP(0x42, "BIT 0, D", 2, { bit_r(state, cpu->d, 0); })
+DMG_CB_OP(0x43, "BIT 0, E", 2, { bit_r(state, cpu->e, 0); })
+DMG_CB_OP(0x44, "BIT 0, H", 2, { bit_r(state, cpu->h, 0); })
+DMG_CB_OP(0x45, "BIT 0, L", 2, { bit_r(state, cpu->l, 0); })
+DMG_CB_OP(0x46, "BIT 0, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 0); })
+DMG_CB_OP(0x47, "BIT 0, A", 2, { bit_r(state, cpu->a, 0); })
+DMG_CB_OP(0x48, "BIT 1, B", 2, { bit_r(state, cpu->b, 1); })
+DMG_CB_OP(0x49, "BIT 1, C", 2, { bit_r(state, cpu->c, 1); })
+DMG_CB_OP(0x4A, "BIT 1, D", 2, { bit_r(state, cpu->d, 1); })
+DMG_CB_OP(0x4B, "BIT 1, E", 2, { bit_r(state, cpu->e, 1); })
+DMG_CB_OP(0x4C, "BIT 1, H", 2, { bit_r(state, cpu->h, 1); })
+DMG_CB_OP(0x4D, "BIT 1, L", 2, { bit_r(state, cpu->l, 1); })
+DMG_CB_OP(0x4E, "BIT 1, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 1); })
+DMG_CB_OP(0x4F, "BIT 1, A", 2, { bit_r(state, cpu->a, 1); })
+DMG_CB_OP(0x50, "BIT 2, B", 2, { bit_r(state, cpu->b, 2); })
+DMG_CB_OP(0x51, "BIT 2, C", 2, { bit_r(state, cpu->c, 2); })
+DMG_CB_OP(0x52, "BIT 2, D", 2, { bit_r(state, cpu->d, 2); })
+DMG_CB_OP(0x53, "BIT 2, E", 2, { bit_r(state, cpu->e, 2); })
+DMG_CB_OP(0x54, "BIT 2, H", 2, { bit_r(state, cpu->h, 2); })
+DMG_CB_OP(0x55, "BIT 2, L", 2, { bit_r(state, cpu->l, 2); })
+DMG_CB_OP(0x56, "BIT 2, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 2); })
+DMG_CB_OP(0x57, "BIT 2, A", 2, { bit_r(state, cpu->a, 2); })
+DMG_CB_OP(0x58, "BIT 3, B", 2, { bit_r(state, cpu->b, 3); })
+DMG_CB_OP(0x59, "BIT 3, C", 2, { bit_r(state, cpu->c, 3); })
+DMG_CB_OP(0x5A, "BIT 3, D", 2, { bit_r(state, cpu->d, 3); })
+DMG_CB_OP(0x5B, "BIT 3, E", 2, { bit_r(state, cpu->e, 3); })
+DMG_CB_OP(0x5C, "BIT 3, H", 2, { bit_r(state, cpu->h, 3); })
+DMG_CB_OP(0x5D, "BIT 3, L", 2, { bit_r(state, cpu->l, 3); })
+DMG_CB_OP(0x5E, "BIT 3, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 3); })
+DMG_CB_OP(0x5F, "BIT 3, A", 2, { bit_r(state, cpu->a, 3); })
+DMG_CB_OP(0x60, "BIT 4, B", 2, { bit_r(state, cpu->b, 4); })
+DMG_CB_OP(0x61, "BIT 4, C", 2, { bit_r(state, cpu->c, 4); })
+DMG_CB_OP(0x62, "BIT 4, D", 2, { bit_r(state, cpu->d, 4); })
+DMG_CB_OP(0x63, "BIT 4, E", 2, { bit_r(state, cpu->e, 4); })
+DMG_CB_OP(0x64, "BIT 4, H", 2, { bit_r(state, cpu->h, 4); })
+DMG_CB_OP(0x65, "BIT 4, L", 2, { bit_r(state, cpu->l, 4); })
+DMG_CB_OP(0x66, "BIT 4, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 4); })
+DMG_CB_OP(0x67, "BIT 4, A", 2, { bit_r(state, cpu->a, 4); })
+DMG_CB_OP(0x68, "BIT 5, B", 2, { bit_r(state, cpu->b, 5); })
+DMG_CB_OP(0x69, "BIT 5, C", 2, { bit_r(state, cpu->c, 5); })
+DMG_CB_OP(0x6A, "BIT 5, D", 2, { bit_r(state, cpu->d, 5); })
+DMG_CB_OP(0x6B, "BIT 5, E", 2, { bit_r(state, cpu->e, 5); })
+DMG_CB_OP(0x6C, "BIT 5, H", 2, { bit_r(state, cpu->h, 5); })
+DMG_CB_OP(0x6D, "BIT 5, L", 2, { bit_r(state, cpu->l, 5); })
+DMG_CB_OP(0x6E, "BIT 5, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 5); })
+DMG_CB_OP(0x6F, "BIT 5, A", 2, { bit_r(state, cpu->a, 5); })
+DMG_CB_OP(0x70, "BIT 6, B", 2, { bit_r(state, cpu->b, 6); })
+DMG_CB_OP(0x71, "BIT 6, C", 2, { bit_r(state, cpu->c, 6); })
+DMG_CB_OP(0x72, "BIT 6, D", 2, { bit_r(state, cpu->d, 6); })
+DMG_CB_OP(0x73, "BIT 6, E", 2, { bit_r(state, cpu->e, 6); })
+DMG_CB_OP(0x74, "BIT 6, H", 2, { bit_r(state, cpu->h, 6); })
+DMG_CB_OP(0x75, "BIT 6, L", 2, { bit_r(state, cpu->l, 6); })
+DMG_CB_OP(0x76, "BIT 6, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 6); })
+DMG_CB_OP(0x77, "BIT 6, A", 2, { bit_r(state, cpu->a, 6); })
+DMG_CB_OP(0x78, "BIT 7, B", 2, { bit_r(state, cpu->b, 7); })
+DMG_CB_OP(0x79, "BIT 7, C", 2, { bit_r(state, cpu->c, 7); })
+DMG_CB_OP(0x7A, "BIT 7, D", 2, { bit_r(state, cpu->d, 7); })
+DMG_CB_OP(0x7B, "BIT 7, E", 2, { bit_r(state, cpu->e, 7); })
+DMG_CB_OP(0x7C, "BIT 7, H", 2, { bit_r(state, cpu->h, 7); })
+DMG_CB_OP(0x7D, "BIT 7, L", 2, { bit_r(state, cpu->l, 7); })
+DMG_CB_OP(0x7E, "BIT 7, (HL)", 2, { bit_r(state, read8(state, cpu->hl), 7); })
+DMG_CB_OP(0x7F, "BIT 7, A", 2, { bit_r(state, cpu->a, 7); })
+DMG_CB_OP(0x80, "RES 0, B", 2, { set_bit(&cpu->b, 0, false); })
+DMG_CB_OP(0x81, "RES 0, C", 2, { set_bit(&cpu->c, 0, false); })
+DMG_CB_OP(0x82, "RES 0, D", 2, { set_bit(&cpu->d, 0, false); })
+DMG_CB_OP(0x83, "RES 0, E", 2, { set_bit(&cpu->e, 0, false); })
+DMG_CB_OP(0x84, "RES 0, H", 2, { set_bit(&cpu->h, 0, false); })
+DMG_CB_OP(0x85, "RES 0, L", 2, { set_bit(&cpu->l, 0, false); })
+DMG_CB_OP(0x86, "RES 0, (HL)", 2, { set_bit_mem_hl(state, 0, false); })
+DMG_CB_OP(0x87, "RES 0, A", 2, { set_bit(&cpu->a, 0, false); })
+DMG_CB_OP(0x88, "RES 1, B", 2, { set_bit(&cpu->b, 1, false); })
+DMG_CB_OP(0x89, "RES 1, C", 2, { set_bit(&cpu->c, 1, false); })
+DMG_CB_OP(0x8A, "RES 1, D", 2, { set_bit(&cpu->d, 1, false); })
+DMG_CB_OP(0x8B, "RES 1, E", 2, { set_bit(&cpu->e, 1, false); })
+DMG_CB_OP(0x8C, "RES 1, H", 2, { set_bit(&cpu->h, 1, false); })
+DMG_CB_OP(0x8D, "RES 1, L", 2, { set_bit(&cpu->l, 1, false); })
+DMG_CB_OP(0x8E, "RES 1, (HL)", 2, { set_bit_mem_hl(state, 1, false); })
+DMG_CB_OP(0x8F, "RES 1, A", 2, { set_bit(&cpu->a, 1, false); })
+DMG_CB_OP(0x90, "RES 2, B", 2, { set_bit(&cpu->b, 2, false); })
+DMG_CB_OP(0x91, "RES 2, C", 2, { set_bit(&cpu->c, 2, false); })
+DMG_CB_OP(0x92, "RES 2, D", 2, { set_bit(&cpu->d, 2, false); })
+DMG_CB_OP(0x93, "RES 2, E", 2, { set_bit(&cpu->e, 2, false); })
+DMG_CB_OP(0x94, "RES 2, H", 2, { set_bit(&cpu->h, 2, false); })
+DMG_CB_OP(0x95, "RES 2, L", 2, { set_bit(&cpu->l, 2, false); })
+DMG_CB_OP(0x96, "RES 2, (HL)", 2, { set_bit_mem_hl(state, 2, false); })
+DMG_CB_OP(0x97, "RES 2, A", 2, { set_bit(&cpu->a, 2, false); })
+DMG_CB_OP(0x98, "RES 3, B", 2, { set_bit(&cpu->b, 3, false); })
+DMG_CB_OP(0x99, "RES 3, C", 2, { set_bit(&cpu->c, 3, false); })
+DMG_CB_OP(0x9A, "RES 3, D", 2, { set_bit(&cpu->d, 3, false); })
+DMG_CB_OP(0x9B, "RES 3, E", 2, { set_bit(&cpu->e, 3, false); })
+DMG_CB_OP(0x9C, "RES 3, H", 2, { set_bit(&cpu->h, 3, false); })
+DMG_CB_OP(0x9D, "RES 3, L", 2, { set_bit(&cpu->l, 3, false); })
+DMG_CB_OP(0x9E, "RES 3, (HL)", 2, { set_bit_mem_hl(state, 3, false); })
+DMG_CB_OP(0x9F, "RES 3, A", 2, { set_bit(&cpu->a, 3, false); })
+DMG_CB_OP(0xA0, "RES 4, B", 2, { set_bit(&cpu->b, 4, false); })
+DMG_CB_OP(0xA1, "RES 4, C", 2, { set_bit(&cpu->c, 4, false); })
+DMG_CB_OP(0xA2, "RES 4, D", 2, { set_bit(&cpu->d, 4, false); })
+DMG_CB_OP(0xA3, "RES 4, E", 2, { set_bit(&cpu->e, 4, false); })
+DMG_CB_OP(0xA4, "RES 4, H", 2, { set_bit(&cpu->h, 4, false); })
+DMG_CB_OP(0xA5, "RES 4, L", 2, { set_bit(&cpu->l, 4, false); })
+DMG_CB_OP(0xA6, "RES 4, (HL)", 2, { set_bit_mem_hl(state, 4, false); })
+DMG_CB_OP(0xA7, "RES 4, A", 2, { set_bit(&cpu->a, 4, false); })
+DMG_CB_OP(0xA8, "RES 5, B", 2, { set_bit(&cpu->b, 5, false); })
+DMG_CB_OP(0xA9, "RES 5, C", 2, { set_bit(&cpu->c, 5, false); })
+DMG_CB_OP(0xAA, "RES 5, D", 2, { set_bit(&cpu->d, 5, false); })
+DMG_CB_OP(0xAB, "RES 5, E", 2, { set_bit(&cpu->e, 5, false); })
+DMG_CB_OP(0xAC, "RES 5, H", 2, { set_bit(&cpu->h, 5, false); })
+DMG_CB_OP(0xAD, "RES 5, L", 2, { set_bit(&cpu->l, 5, false); })
+DMG_CB_OP(0xAE, "RES 5, (HL)", 2, { set_bit_mem_hl(state, 5, false); })
+DMG_CB_OP(0xAF, "RES 5, A", 2, { set_bit(&cpu->a, 5, false); })
+DMG_CB_OP(0xB0, "RES 6, B", 2, { set_bit(&cpu->b, 6, false); })
+DMG_CB_OP(0xB1, "RES 6, C", 2, { set_bit(&cpu->c, 6, false); })
+DMG_CB_OP(0xB2, "RES 6, D", 2, { set_bit(&cpu->d, 6, false); })
+DMG_CB_OP(0xB3, "RES 6, E", 2, { set_bit(&cpu->e, 6, false); })
+DMG_CB_OP(0xB4, "RES 6, H", 2, { set_bit(&cpu->h, 6, false); })
+DMG_CB_OP(0xB5, "RES 6, L", 2, { set_bit(&cpu->l, 6, false); })
+DMG_CB_OP(0xB6, "RES 6, (HL)", 2, { set_bit_mem_hl(state, 6, false); })
+DMG_CB_OP(0xB7, "RES 6, A", 2, { set_bit(&cpu->a, 6, false); })
+DMG_CB_OP(0xB8, "RES 7, B", 2, { set_bit(&cpu->b, 7, false); })
+DMG_CB_OP(0xB9, "RES 7, C", 2, { set_bit(&cpu->c, 7, false); })
+DMG_CB_OP(0xBA, "RES 7, D", 2, { set_bit(&cpu->d, 7, false); })
+DMG_CB_OP(0xBB, "RES 7, E", 2, { set_bit(&cpu->e, 7, false); })
+DMG_CB_OP(0xBC, "RES 7, H", 2, { set_bit(&cpu->h, 7, false); })
+DMG_CB_OP(0xBD, "RES 7, L", 2, { set_bit(&cpu->l, 7, false); })
+DMG_CB_OP(0xBE, "RES 7, (HL)", 2, { set_bit_mem_hl(state, 7, false); })
+DMG_CB_OP(0xBF, "RES 7, A", 2, { set_bit(&cpu->a, 7, false); })
+DMG_CB_OP(0xC0, "SET 0, B", 2, { set_bit(&cpu->b, 0, true); })
+DMG_CB_OP(0xC1, "SET 0, C", 2, { set_bit(&cpu->c, 0, true); })
+DMG_CB_OP(0xC2, "SET 0, D", 2, { set_bit(&cpu->d, 0, true); })
+DMG_CB_OP(0xC3, "SET 0, E", 2, { set_bit(&cpu->e, 0, true); })
+DMG_CB_OP(0xC4, "SET 0, H", 2, { set_bit(&cpu->h, 0, true); })
+DMG_CB_OP(0xC5, "SET 0, L", 2, { set_bit(&cpu->l, 0, true); })
+DMG_CB_OP(0xC6, "SET 0, (HL)", 2, { set_bit_mem_hl(state, 0, true); })
+DMG_CB_OP(0xC7, "SET 0, A", 2, { set_bit(&cpu->a, 0, true); })
+DMG_CB_OP(0xC8, "SET 1, B", 2, { set_bit(&cpu->b, 1, true); })
+DMG_CB_OP(0xC9, "SET 1, C", 2, { set_bit(&cpu->c, 1, true); })
+DMG_CB_OP(0xCA, "SET 1, D", 2, { set_bit(&cpu->d, 1, true); })
+DMG_CB_OP(0xCB, "SET 1, E", 2, { set_bit(&cpu->e, 1, true); })
+DMG_CB_OP(0xCC, "SET 1, H", 2, { set_bit(&cpu->h, 1, true); })
+DMG_CB_OP(0xCD, "SET 1, L", 2, { set_bit(&cpu->l, 1, true); })
+DMG_CB_OP(0xCE, "SET 1, (HL)", 2, { set_bit_mem_hl(state, 1, true); })
+DMG_CB_OP(0xCF, "SET 1, A", 2, { set_bit(&cpu->a, 1, true); })
+DMG_CB_OP(0xD0, "SET 2, B", 2, { set_bit(&cpu->b, 2, true); })
+DMG_CB_OP(0xD1, "SET 2, C", 2, { set_bit(&cpu->c, 2, true); })
+DMG_CB_OP(0xD2, "SET 2, D", 2, { set_bit(&cpu->d, 2, true); })
+DMG_CB_OP(0xD3, "SET 2, E", 2, { set_bit(&cpu->e, 2, true); })
+DMG_CB_OP(0xD4, "SET 2, H", 2, { set_bit(&cpu->h, 2, true); })
+DMG_CB_OP(0xD5, "SET 2, L", 2, { set_bit(&cpu->l, 2, true); })
+DMG_CB_OP(0xD6, "SET 2, (HL)", 2, { set_bit_mem_hl(state, 2, true); })
+DMG_CB_OP(0xD7, "SET 2, A", 2, { set_bit(&cpu->a, 2, true); })
+DMG_CB_OP(0xD8, "SET 3, B", 2, { set_bit(&cpu->b, 3, true); })
+DMG_CB_OP(0xD9, "SET 3, C", 2, { set_bit(&cpu->c, 3, true); })
+DMG_CB_OP(0xDA, "SET 3, D", 2, { set_bit(&cpu->d, 3, true); })
+DMG_CB_OP(0xDB, "SET 3, E", 2, { set_bit(&cpu->e, 3, true); })
+DMG_CB_OP(0xDC, "SET 3, H", 2, { set_bit(&cpu->h, 3, true); })
+DMG_CB_OP(0xDD, "SET 3, L", 2, { set_bit(&cpu->l, 3, true); })
+DMG_CB_OP(0xDE, "SET 3, (HL)", 2, { set_bit_mem_hl(state, 3, true); })
+DMG_CB_OP(0xDF, "SET 3, A", 2, { set_bit(&cpu->a, 3, true); })
+DMG_CB_OP(0xE0, "SET 4, B", 2, { set_bit(&cpu->b, 4, true); })
+DMG_CB_OP(0xE1, "SET 4, C", 2, { set_bit(&cpu->c, 4, true); })
+DMG_CB_OP(0xE2, "SET 4, D", 2, { set_bit(&cpu->d, 4, true); })
+DMG_CB_OP(0xE3, "SET 4, E", 2, { set_bit(&cpu->e, 4, true); })
+DMG_CB_OP(0xE4, "SET 4, H", 2, { set_bit(&cpu->h, 4, true); })
+DMG_CB_OP(0xE5, "SET 4, L", 2, { set_bit(&cpu->l, 4, true); })
+DMG_CB_OP(0xE6, "SET 4, (HL)", 2, { set_bit_mem_hl(state, 4, true); })
+DMG_CB_OP(0xE7, "SET 4, A", 2, { set_bit(&cpu->a, 4, true); })
+DMG_CB_OP(0xE8, "SET 5, B", 2, { set_bit(&cpu->b, 5, true); })
+DMG_CB_OP(0xE9, "SET 5, C", 2, { set_bit(&cpu->c, 5, true); })
+DMG_CB_OP(0xEA, "SET 5, D", 2, { set_bit(&cpu->d, 5, true); })
+DMG_CB_OP(0xEB, "SET 5, E", 2, { set_bit(&cpu->e, 5, true); })
+DMG_CB_OP(0xEC, "SET 5, H", 2, { set_bit(&cpu->h, 5, true); })
+DMG_CB_OP(0xED, "SET 5, L", 2, { set_bit(&cpu->l, 5, true); })
+DMG_CB_OP(0xEE, "SET 5, (HL)", 2, { set_bit_mem_hl(state, 5, true); })
+DMG_CB_OP(0xEF, "SET 5, A", 2, { set_bit(&cpu->a, 5, true); })
+DMG_CB_OP(0xF0, "SET 6, B", 2, { set_bit(&cpu->b, 6, true); })
+DMG_CB_OP(0xF1, "SET 6, C", 2, { set_bit(&cpu->c, 6, true); })
+DMG_CB_OP(0xF2, "SET 6, D", 2, { set_bit(&cpu->d, 6, true); })
+DMG_CB_OP(0xF3, "SET 6, E", 2, { set_bit(&cpu->e, 6, true); })
+DMG_CB_OP(0xF4, "SET 6, H", 2, { set_bit(&cpu->h, 6, true); })
+DMG_CB_OP(0xF5, "SET 6, L", 2, { set_bit(&cpu->l, 6, true); })
+DMG_CB_OP(0xF6, "SET 6, (HL)", 2, { set_bit_mem_hl(state, 6, true); })
+DMG_CB_OP(0xF7, "SET 6, A", 2, { set_bit(&cpu->a, 6, true); })
+DMG_CB_OP(0xF8, "SET 7, B", 2, { set_bit(&cpu->b, 7, true); })
+DMG_CB_OP(0xF9, "SET 7, C", 2, { set_bit(&cpu->c, 7, true); })
+DMG_CB_OP(0xFA, "SET 7, D", 2, { set_bit(&cpu->d, 7, true); })
+DMG_CB_OP(0xFB, "SET 7, E", 2, { set_bit(&cpu->e, 7, true); })
+DMG_CB_OP(0xFC, "SET 7, H", 2, { set_bit(&cpu->h, 7, true); })
+DMG_CB_OP(0xFD, "SET 7, L", 2, { set_bit(&cpu->l, 7, true); })
+DMG_CB_OP(0xFE, "SET 7, (HL)", 2, { set_bit_mem_hl(state, 7, true); })
+DMG_CB_OP(0xFF, "SET 7, A", 2, { set_bit(&cpu->a, 7, true); })
+
+#undef DMG_OP
+#undef DMG_CB_OP
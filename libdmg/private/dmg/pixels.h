@@ -0,0 +1,12 @@
+#ifndef DMG_PIXELS_H
+#define DMG_PIXELS_H
+
+#include <dmg/porting.h>
+
+/**
+ * Colours `count` pixels: `out[x] = colors[pixels[x]]` for colour numbers
+ * 0-3. Runs on the widest kernel the host CPU supports (DMG_SIMD).
+ */
+void dmg_pixels_color(uint32_t *out, const uint8_t *pixels, const uint32_t colors[4], size_t count);
+
+#endif // DMG_PIXELS_H
@@ -0,0 +1,290 @@
+#include <dmg/cart.h>
+#include <dmg/mmu.h>
+#include <dmg/state.h>
+
+#include <string.h>
+
+#define DMG_CART_BANK_SIZE 0x4000
+#define DMG_CART_RAM_BANK_SIZE 0x2000
+#define DMG_CART_CLOCK_HZ 4194304
+
+// Bytes of RAM for each RAM size code at 0x0149
+static const uint32_t RAM_SIZES[] = {0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000};
+
+/**
+ * Maps the banks selected by the bank registers. Only regions whose bank
+ * actually changed are remapped, straight to their new base in the image.
+ */
+static void map_rom(DMGState *state) {
+    DMGCart *cart = &state->cart;
+    uint16_t bank0 = 0;
+    uint16_t bankx = cart->rom_bank;
+    if (cart->type == DMG_CART_MBC1) {
+        bankx |= cart->bank_high << 5;
+        if (cart->mode) {
+            bank0 = (uint16_t) (cart->bank_high << 5);
+        }
+    }
+    bank0 &= cart->rom_banks - 1;
+    bankx &= cart->rom_banks - 1;
+
+    if (bank0 != cart->bank0 || !cart->rom0) {
+        cart->bank0 = bank0;
+        cart->rom0 = state->rom + (size_t) bank0 * DMG_CART_BANK_SIZE;
+        // The boot ROM covers the first page until it is switched off
+        uint16_t start = state->mmu.io[DMG_IO_BIOS] == 0x00 ? 0x0100 : 0x0000;
+        dmg_mmu_map(state, start, 0x3FFF, cart->rom0 + start);
+        state->blocks.dirty = true;
+        state->blocks.epoch++;
+    }
+    if (bankx != cart->bankx || !cart->romx) {
+        cart->bankx = bankx;
+        cart->romx = state->rom + (size_t) bankx * DMG_CART_BANK_SIZE;
+        dmg_mmu_map(state, 0x4000, 0x7FFF, cart->romx);
+        state->blocks.dirty = true;
+        state->blocks.epoch++;
+    }
+}
+
+/**
+ * Drops the mapping of 0xA000-0xBFFF after the RAM enable or bank changed,
+ * it is mapped again on the next access
+ */
+static void unmap_ram(DMGState *state) {
+    dmg_mmu_map(state, 0xA000, 0xBFFF, NULL);
+}
+
+static DMG_INLINE bool rtc_selected(DMGCart *cart) {
+    return cart->has_rtc && cart->ram_enabled && cart->ram_bank >= 0x08 && cart->ram_bank <= 0x0C;
+}
+
+/**
+ * Advances the clock by the whole seconds elapsed since it was last synced
+ */
+static void rtc_sync(DMGState *state) {
+    DMGRtc *rtc = &state->cart.rtc;
+    if (rtc->live[DMG_RTC_DH] & 0x40) {
+        // Halted
+        rtc->synced = state->cycles;
+        return;
+    }
+    uint64_t seconds = (state->cycles - rtc->synced) / DMG_CART_CLOCK_HZ;
+    if (!seconds) {
+        return;
+    }
+    rtc->synced += seconds * DMG_CART_CLOCK_HZ;
+
+    uint8_t *live = rtc->live;
+    uint64_t days = live[DMG_RTC_DL] | ((live[DMG_RTC_DH] & 0x01) << 8);
+    uint64_t total = live[DMG_RTC_S] + live[DMG_RTC_M] * 60u + live[DMG_RTC_H] * 3600u + days * 86400u + seconds;
+    days = total / 86400;
+    live[DMG_RTC_S] = (uint8_t) (total % 60);
+    live[DMG_RTC_M] = (uint8_t) (total / 60 % 60);
+    live[DMG_RTC_H] = (uint8_t) (total / 3600 % 24);
+    live[DMG_RTC_DL] = (uint8_t) days;
+    live[DMG_RTC_DH] = (uint8_t) ((live[DMG_RTC_DH] & 0xC0) | ((days >> 8) & 0x01));
+    if (days > 0x1FF) {
+        // Day counter overflow sticks until the game clears it
+        live[DMG_RTC_DH] |= 0x80;
+    }
+}
+
+bool dmg_cart_insert(DMGState *state, const uint8_t *rom, size_t size) {
+    if (size < 2 * DMG_CART_BANK_SIZE) {
+        return false;
+    }
+    DMGCart *cart = &state->cart;
+    memset(cart, 0, sizeof(DMGCart));
+    switch (rom[0x0147]) {
+        case 0x00:
+        case 0x08:
+            cart->type = DMG_CART_ROM;
+            break;
+        case 0x09:
+            cart->type = DMG_CART_ROM;
+            cart->has_battery = true;
+            break;
+        case 0x01:
+        case 0x02:
+            cart->type = DMG_CART_MBC1;
+            break;
+        case 0x03:
+            cart->type = DMG_CART_MBC1;
+            cart->has_battery = true;
+            break;
+        case 0x0F:
+        case 0x10:
+            cart->has_rtc = true;
+            cart->has_battery = true;
+            cart->type = DMG_CART_MBC3;
+            break;
+        case 0x11:
+        case 0x12:
+            cart->type = DMG_CART_MBC3;
+            break;
+        case 0x13:
+            cart->type = DMG_CART_MBC3;
+            cart->has_battery = true;
+            break;
+        case 0x19:
+        case 0x1A:
+        case 0x1C:
+        case 0x1D:
+            cart->type = DMG_CART_MBC5;
+            break;
+        case 0x1B:
+        case 0x1E:
+            cart->type = DMG_CART_MBC5;
+            cart->has_battery = true;
+            break;
+        default:
+            return false;
+    }
+    if (rom[0x0148] > 0x08 || rom[0x0149] >= sizeof(RAM_SIZES) / sizeof(RAM_SIZES[0])) {
+        return false;
+    }
+
+    // A truncated image keeps the banks it has, selecting the others wraps
+    cart->rom_banks = (uint16_t) (2 << rom[0x0148]);
+    while ((size_t) cart->rom_banks * DMG_CART_BANK_SIZE > size) {
+        cart->rom_banks >>= 1;
+    }
+    uint32_t ram_size = RAM_SIZES[rom[0x0149]];
+    cart->ram_banks = (uint8_t) ((ram_size + DMG_CART_RAM_BANK_SIZE - 1) / DMG_CART_RAM_BANK_SIZE);
+    cart->ram_mask = (uint16_t) (ram_size && ram_size < DMG_CART_RAM_BANK_SIZE ? ram_size - 1 : DMG_CART_RAM_BANK_SIZE - 1);
+    if (cart->type == DMG_CART_ROM && cart->ram_banks > 1) {
+        cart->ram_banks = 1;
+    }
+    // Without a controller RAM is always on
+    cart->ram_enabled = cart->type == DMG_CART_ROM;
+    cart->rom_bank = 1;
+    cart->rtc.synced = state->cycles;
+
+    state->rom = rom;
+    state->rom_size = size;
+    dmg_mmu_unmap(state);
+    map_rom(state);
+    return true;
+}
+
+void dmg_cart_write(DMGState *state, uint16_t address, uint8_t byte) {
+    DMGCart *cart = &state->cart;
+    if (cart->type == DMG_CART_ROM) {
+        return;
+    }
+    switch (address >> 13) {
+        case 0: { // 0x0000-0x1FFF
+            bool enabled = (byte & 0x0F) == 0x0A;
+            if (cart->save && cart->ram_enabled && !enabled) {
+                // Games disable RAM once they are done writing a save
+                cart->save_pending = true;
+            }
+            cart->ram_enabled = enabled;
+            unmap_ram(state);
+            break;
+        }
+
+        case 1: // 0x2000-0x3FFF
+            if (cart->type == DMG_CART_MBC1) {
+                cart->rom_bank = (uint16_t) (byte & 0x1F ? byte & 0x1F : 1);
+            } else if (cart->type == DMG_CART_MBC3) {
+                cart->rom_bank = (uint16_t) (byte & 0x7F ? byte & 0x7F : 1);
+            } else if (address < 0x3000) {
+                cart->rom_bank = (uint16_t) ((cart->rom_bank & 0x100) | byte);
+            } else {
+                cart->rom_bank = (uint16_t) ((cart->rom_bank & 0xFF) | ((byte & 0x01) << 8));
+            }
+            map_rom(state);
+            break;
+
+        case 2: // 0x4000-0x5FFF
+            if (cart->type == DMG_CART_MBC1) {
+                cart->bank_high = (uint8_t) (byte & 0x03);
+                map_rom(state);
+            } else {
+                cart->ram_bank = (uint8_t) (byte & 0x0F);
+            }
+            unmap_ram(state);
+            break;
+
+        case 3: // 0x6000-0x7FFF
+            if (cart->type == DMG_CART_MBC1) {
+                cart->mode = (uint8_t) (byte & 0x01);
+                map_rom(state);
+                unmap_ram(state);
+            } else if (cart->type == DMG_CART_MBC3) {
+                if (cart->has_rtc && cart->rtc.latch == 0x00 && byte == 0x01) {
+                    rtc_sync(state);
+                    memcpy(cart->rtc.latched, cart->rtc.live, DMG_RTC_COUNT);
+                }
+                cart->rtc.latch = byte;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+uint8_t *dmg_cart_ram(DMGState *state) {
+    DMGCart *cart = &state->cart;
+    if (!cart->ram_enabled || !cart->ram_banks) {
+        return NULL;
+    }
+    uint8_t bank;
+    switch (cart->type) {
+        case DMG_CART_MBC1:
+            bank = cart->mode ? cart->bank_high : 0;
+            break;
+        case DMG_CART_MBC3:
+            if (cart->ram_bank > 0x03) {
+                return NULL;
+            }
+            // fallthrough
+        case DMG_CART_MBC5:
+            bank = cart->ram_bank;
+            break;
+        default:
+            bank = 0;
+            break;
+    }
+    uint8_t *ram = cart->save ? cart->save->data : state->mmu.cram;
+    return ram + (size_t) (bank & (cart->ram_banks - 1)) * DMG_CART_RAM_BANK_SIZE;
+}
+
+size_t dmg_cart_ram_size(DMGState *state) {
+    return (size_t) state->cart.ram_banks * (state->cart.ram_mask + 1u);
+}
+
+bool dmg_cart_attach_save(DMGState *state, DMGSave *save) {
+    DMGCart *cart = &state->cart;
+    if (!cart->has_battery || !save->data || save->size < dmg_cart_ram_size(state)) {
+        return false;
+    }
+    cart->save = save;
+    unmap_ram(state);
+    return true;
+}
+
+uint8_t dmg_cart_read_ram(DMGState *state, uint16_t address) {
+    DMGCart *cart = &state->cart;
+    if (rtc_selected(cart)) {
+        return cart->rtc.latched[cart->ram_bank - 0x08];
+    }
+    return 0xFF;
+}
+
+void dmg_cart_write_ram(DMGState *state, uint16_t address, uint8_t byte) {
+    static const uint8_t MASKS[DMG_RTC_COUNT] = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+    DMGCart *cart = &state->cart;
+    if (!rtc_selected(cart)) {
+        return;
+    }
+    DMGRtcRegister reg = (DMGRtcRegister) (cart->ram_bank - 0x08);
+    rtc_sync(state);
+    cart->rtc.live[reg] = cart->rtc.latched[reg] = byte & MASKS[reg];
+    if (reg == DMG_RTC_S) {
+        // Writing the seconds restarts the current second
+        cart->rtc.synced = state->cycles;
+    }
+}
@@ -1,14 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <dmg/cpu.h>
+#include <dmg/irq.h>
 #include <dmg/state.h>
 
+#ifdef DMG_JIT
+#include <dmg/jit.h>
+#endif
+
+#ifndef DMG_CPU_ENGINE
+#define DMG_CPU_ENGINE DMG_CPU_ENGINE_BLOCK
+#endif
+
+/**
+ * HRAM shares its page with IO, so it never gets a page table entry and is
+ * special-cased instead
+ */
+static DMG_INLINE bool is_hram(uint16_t address) {
+    return address >= 0xFF80 && address != 0xFFFF;
+}
+
+// The page table fast paths of dmg_mmu_read and dmg_mmu_write, inlined
+static DMG_INLINE uint8_t mmu_read(DMGState *state, uint16_t address) {
+    const uint8_t *page = state->pages.read[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    if (is_hram(address)) {
+        return state->mmu.hram[address - 0xFF80];
+    }
+    return dmg_mmu_read_slow(state, address);
+}
+
+static DMG_INLINE void mmu_write(DMGState *state, uint16_t address, uint8_t byte) {
+    // Writes to lines cached code came from go the long way to drop it
+    if (!state->blocks.code[address >> DMG_BLOCK_LINE_BITS]) {
+        uint8_t *page = state->pages.write[address >> 8];
+        if (page) {
+            page[address & 0xFF] = byte;
+            return;
+        }
+        if (is_hram(address)) {
+            state->mmu.hram[address - 0xFF80] = byte;
+            return;
+        }
+    }
+    dmg_mmu_write(state, address, byte);
+}
+
 static DMG_INLINE uint8_t read8(DMGState *state, uint16_t address) {
     state->cycles += 4;
-    return dmg_mmu_read(state, address);
+    return mmu_read(state, address);
 }
 
 static DMG_INLINE uint16_t read16(DMGState *state, uint16_t address) {
     state->cycles += 8;
-    return dmg_mmu_read(state, address) | (dmg_mmu_read(state, (uint16_t) (address + 1)) << 8);
+    return mmu_read(state, address) | (mmu_read(state, (uint16_t) (address + 1)) << 8);
 }
 
 static DMG_INLINE uint8_t read8_pc(DMGState *state) {
@@ -25,13 +73,13 @@ static DMG_INLINE uint16_t read16_pc(DMGState *state) {
 
 static DMG_INLINE void write8(DMGState *state, uint16_t address, uint8_t byte) {
     state->cycles += 4;
-    dmg_mmu_write(state, address, byte);
+    mmu_write(state, address, byte);
 }
 
 static DMG_INLINE void write16(DMGState *state, uint16_t address, uint16_t bytes) {
     state->cycles += 8;
-    dmg_mmu_write(state, address, (uint8_t) (bytes & 0xFF));
-    dmg_mmu_write(state, (uint16_t) (address + 1), (uint8_t) (bytes >> 8));
+    mmu_write(state, address, (uint8_t) (bytes & 0xFF));
+    mmu_write(state, (uint16_t) (address + 1), (uint8_t) (bytes >> 8));
 }
 
 static DMG_INLINE void set_bit(uint8_t *byte, uint8_t n, bool value) {
@@ -42,36 +90,126 @@ static DMG_INLINE bool get_bit(uint8_t *byte, uint8_t n) {
     return ((*byte >> n) & 0x01) != 0x00;
 }
 
-static DMG_INLINE void set_z(uint8_t *f, bool value) {
-    set_bit(f, 7, value);
-}
-
-static DMG_INLINE void set_n(uint8_t *f, bool value) {
-    set_bit(f, 6, value);
+#define DMG_FLAG_Z 0x80
+#define DMG_FLAG_N 0x40
+#define DMG_FLAG_H 0x20
+#define DMG_FLAG_C 0x10
+
+#ifdef DMG_LAZY_FLAGS
+/**
+ * Flags each deferred operation defines. Anything not in the mask is carried
+ * over from `f`.
+ */
+static const uint8_t FLAGS_DEFINED[] = {
+        [DMG_FLAGS_NONE] = 0x00,
+        [DMG_FLAGS_ADD] = DMG_FLAG_Z | DMG_FLAG_N | DMG_FLAG_H | DMG_FLAG_C,
+        [DMG_FLAGS_SUB] = DMG_FLAG_Z | DMG_FLAG_N | DMG_FLAG_H | DMG_FLAG_C,
+        [DMG_FLAGS_INC] = DMG_FLAG_Z | DMG_FLAG_N | DMG_FLAG_H,
+        [DMG_FLAGS_DEC] = DMG_FLAG_Z | DMG_FLAG_N | DMG_FLAG_H,
+        [DMG_FLAGS_ADD16] = DMG_FLAG_N | DMG_FLAG_H | DMG_FLAG_C,
+};
+#endif
+
+static DMG_INLINE uint8_t flags_of(DMGCpu *cpu, uint8_t op, uint16_t lhs, uint16_t rhs, uint32_t result) {
+    uint8_t z = (uint8_t) (((uint8_t) result == 0x00) << 7);
+    uint8_t h = (uint8_t) ((((lhs ^ rhs ^ result) >> 4) & 0x01) << 5);
+    uint8_t c = (uint8_t) (((result >> 8) & 0x01) << 4);
+    switch (op) {
+        case DMG_FLAGS_ADD:
+            return z | h | c;
+        case DMG_FLAGS_SUB:
+            return z | DMG_FLAG_N | h | c;
+        case DMG_FLAGS_INC:
+            return (uint8_t) (z | ((((uint8_t) result & 0x0F) == 0x00) << 5) | (cpu->f & DMG_FLAG_C));
+        case DMG_FLAGS_DEC:
+            return (uint8_t) (z | DMG_FLAG_N | ((((uint8_t) result & 0x0F) == 0x0F) << 5) | (cpu->f & DMG_FLAG_C));
+        case DMG_FLAGS_ADD16:
+            return (uint8_t) ((cpu->f & DMG_FLAG_Z) | ((((lhs ^ rhs ^ result) >> 12) & 0x01) << 5) | (((result >> 16) & 0x01) << 4));
+        default:
+            break;
+    }
+    return cpu->f;
 }
 
-static DMG_INLINE void set_h(uint8_t *f, bool value) {
-    set_bit(f, 5, value);
+uint8_t dmg_cpu_flags(DMGCpu *cpu) {
+    if (cpu->flags_op != DMG_FLAGS_NONE) {
+        cpu->f = flags_of(cpu, cpu->flags_op, cpu->flags_lhs, cpu->flags_rhs, cpu->flags_result);
+        cpu->flags_op = DMG_FLAGS_NONE;
+    }
+    return cpu->f;
 }
 
-static DMG_INLINE void set_c(uint8_t *f, bool value) {
-    set_bit(f, 4, value);
+/**
+ * Records the flag effect of an arithmetic operation. With DMG_LAZY_FLAGS the
+ * operands are only stashed and F is derived when something reads it.
+ */
+static DMG_INLINE void defer_flags(DMGState *state, uint8_t op, uint16_t lhs, uint16_t rhs, uint32_t result) {
+    DMGCpu *cpu = &state->cpu;
+#ifdef DMG_LAZY_FLAGS
+    cpu->flags_op = op;
+    cpu->flags_lhs = lhs;
+    cpu->flags_rhs = rhs;
+    cpu->flags_result = result;
+#else
+    cpu->f = flags_of(cpu, op, lhs, rhs, result);
+#endif
+}
+
+/**
+ * Makes the given bits of `f` current before an operation that preserves them.
+ */
+static DMG_INLINE void keep_flags(DMGState *state, uint8_t mask) {
+#ifdef DMG_LAZY_FLAGS
+    DMGCpu *cpu = &state->cpu;
+    if (FLAGS_DEFINED[cpu->flags_op] & mask) {
+        dmg_cpu_flags(cpu);
+    }
+#endif
 }
 
-static DMG_INLINE bool get_z(uint8_t *f) {
-    return get_bit(f, 7);
+/**
+ * Rewrites `f` keeping only the bits in `keep`.
+ */
+static DMG_INLINE void update_flags(DMGState *state, uint8_t keep, uint8_t bits) {
+    keep_flags(state, keep);
+    DMGCpu *cpu = &state->cpu;
+    cpu->f = (uint8_t) ((cpu->f & keep) | bits);
+    cpu->flags_op = DMG_FLAGS_NONE;
 }
 
-static DMG_INLINE bool get_n(uint8_t *f) {
-    return get_bit(f, 6);
+/**
+ * Overwrites all four flags at once.
+ */
+static DMG_INLINE void set_flags(DMGState *state, bool z, bool n, bool h, bool c) {
+    DMGCpu *cpu = &state->cpu;
+    cpu->f = (uint8_t) ((z << 7) | (n << 6) | (h << 5) | (c << 4));
+    cpu->flags_op = DMG_FLAGS_NONE;
 }
 
-static DMG_INLINE bool get_h(uint8_t *f) {
-    return get_bit(f, 5);
+static DMG_INLINE bool get_z(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
+#ifdef DMG_LAZY_FLAGS
+    if (FLAGS_DEFINED[cpu->flags_op] & DMG_FLAG_Z) {
+        return (uint8_t) cpu->flags_result == 0x00;
+    }
+#endif
+    return (cpu->f & DMG_FLAG_Z) != 0x00;
 }
 
-static DMG_INLINE bool get_c(uint8_t *f) {
-    return get_bit(f, 4);
+static DMG_INLINE bool get_c(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
+#ifdef DMG_LAZY_FLAGS
+    switch (cpu->flags_op) {
+        case DMG_FLAGS_ADD:
+        case DMG_FLAGS_SUB:
+            return ((cpu->flags_result >> 8) & 0x01) != 0x00;
+        case DMG_FLAGS_ADD16:
+            return ((cpu->flags_result >> 16) & 0x01) != 0x00;
+        default:
+            break;
+    }
+#endif
+    return (cpu->f & DMG_FLAG_C) != 0x00;
 }
 
 static DMG_INLINE void inc_rr(DMGState *state, uint16_t *rr) {
@@ -80,29 +218,25 @@ static DMG_INLINE void inc_rr(DMGState *state, uint16_t *rr) {
 }
 
 static DMG_INLINE void inc_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
-    set_h(f, (*r & 0x0F) == 0x00);
-    *r += 1;
-    set_z(f, *r == 0x00);
-    set_n(f, false);
+    keep_flags(state, DMG_FLAG_C);
+    uint8_t tmp = (uint8_t) (*r + 1);
+    defer_flags(state, DMG_FLAGS_INC, *r, 1, tmp);
+    *r = tmp;
 }
 
 static DMG_INLINE void dec_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
-    set_h(f, (*r & 0x0F) == 0x0F);
-    *r -= 1;
-    set_z(f, *r == 0x00);
-    set_n(f, true);
+    keep_flags(state, DMG_FLAG_C);
+    uint8_t tmp = (uint8_t) (*r - 1);
+    defer_flags(state, DMG_FLAGS_DEC, *r, 1, tmp);
+    *r = tmp;
 }
 
 static DMG_INLINE void add_hl_rr(DMGState *state, uint16_t *rr) {
     state->cycles += 4;
-    uint8_t *f = &state->cpu.f;
+    keep_flags(state, DMG_FLAG_Z);
     uint16_t *hl = &state->cpu.hl;
-    uint32_t overflow = *hl + *rr;
-    set_n(f, false);
-    set_h(f, ((*hl & 0x0FFF) + (*rr & 0x0FFF)) > 0x0FFF);
-    set_c(f, overflow > 0xFFFF);
+    uint32_t overflow = (uint32_t) *hl + *rr;
+    defer_flags(state, DMG_FLAGS_ADD16, *hl, *rr, overflow);
     *hl = (uint16_t) (overflow & 0xFFFF);
 }
 
@@ -112,14 +246,13 @@ static DMG_INLINE void dec_rr(DMGState *state, uint16_t *rr) {
 }
 
 static DMG_INLINE void stop(DMGState *state) {
-    state->cpu.pc += 1;
     // TODO: Not implemented
     assert(false);
 }
 
-static DMG_INLINE void jr_n(DMGState *state) {
+static DMG_INLINE void jr_n(DMGState *state, uint8_t n) {
     state->cycles += 4;
-    state->cpu.pc += (int8_t) read8_pc(state);
+    state->cpu.pc += (int8_t) n;
 }
 
 static DMG_INLINE void ldi_hl_a(DMGState *state) {
@@ -132,42 +265,52 @@ static DMG_INLINE void ldi_a_hl(DMGState *state) {
     state->cpu.hl += 1;
 }
 
-static DMG_INLINE void jr_nz_n(DMGState *state) {
-    if (!get_z(&state->cpu.f)) {
-        jr_n(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 1;
+static DMG_INLINE void jr_nz_n(DMGState *state, uint8_t n) {
+    if (!get_z(state)) {
+        jr_n(state, n);
     }
 }
 
 static DMG_INLINE void daa(DMGState *state) {
-    // TODO: Unimplemented
-    assert(false);
+    uint8_t f = dmg_cpu_flags(&state->cpu);
+    uint8_t *a = &state->cpu.a;
+    uint8_t adjust = 0x00;
+    bool carry = (f & DMG_FLAG_C) != 0x00;
+    if (f & DMG_FLAG_N) {
+        if (f & DMG_FLAG_H) {
+            adjust |= 0x06;
+        }
+        if (carry) {
+            adjust |= 0x60;
+        }
+        *a -= adjust;
+    } else {
+        if ((f & DMG_FLAG_H) || (*a & 0x0F) > 0x09) {
+            adjust |= 0x06;
+        }
+        if (carry || *a > 0x99) {
+            adjust |= 0x60;
+            carry = true;
+        }
+        *a += adjust;
+    }
+    set_flags(state, *a == 0x00, (f & DMG_FLAG_N) != 0x00, false, carry);
 }
 
-static DMG_INLINE void jr_z_n(DMGState *state) {
-    if (get_z(&state->cpu.f)) {
-        jr_n(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 1;
+static DMG_INLINE void jr_z_n(DMGState *state, uint8_t n) {
+    if (get_z(state)) {
+        jr_n(state, n);
     }
 }
 
 static DMG_INLINE void cpl(DMGState *state) {
-    uint8_t *f = &state->cpu.f;
     state->cpu.a ^= 0xFF;
-    set_n(f, true);
-    set_h(f, true);
+    update_flags(state, DMG_FLAG_Z | DMG_FLAG_C, DMG_FLAG_N | DMG_FLAG_H);
 }
 
-static DMG_INLINE void jr_nc_n(DMGState *state) {
-    if (!get_c(&state->cpu.f)) {
-        jr_n(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 1;
+static DMG_INLINE void jr_nc_n(DMGState *state, uint8_t n) {
+    if (!get_c(state)) {
+        jr_n(state, n);
     }
 }
 
@@ -177,40 +320,26 @@ static DMG_INLINE void ldd_hl_a(DMGState *state) {
 }
 
 static DMG_INLINE void inc_mem_hl(DMGState *state) {
-    uint16_t *hl = &state->cpu.hl;
-    uint8_t *f = &state->cpu.f;
-    uint16_t overflow = read8(state, *hl);
-    set_h(f, (overflow & 0x0F) == 0x00);
-    overflow = (uint16_t) ((overflow + 1) & 0xFF);
-    write8(state, *hl, (uint8_t) overflow);
-    set_z(f, overflow == 0x00);
-    set_n(f, false);
+    uint16_t hl = state->cpu.hl;
+    uint8_t tmp = read8(state, hl);
+    inc_r(state, &tmp);
+    write8(state, hl, tmp);
 }
 
 static DMG_INLINE void dec_mem_hl(DMGState *state) {
-    uint16_t *hl = &state->cpu.hl;
-    uint8_t *f = &state->cpu.f;
-    uint16_t overflow = read8(state, *hl);
-    set_h(f, (overflow & 0x0F) == 0x0F);
-    overflow = (uint16_t) ((overflow - 1) & 0xFF);
-    write8(state, *hl, (uint8_t) overflow);
-    set_z(f, overflow == 0x00);
-    set_n(f, true);
+    uint16_t hl = state->cpu.hl;
+    uint8_t tmp = read8(state, hl);
+    dec_r(state, &tmp);
+    write8(state, hl, tmp);
 }
 
 static DMG_INLINE void scf(DMGState *state) {
-    uint8_t *f = &state->cpu.f;
-    set_c(f, true);
-    set_h(f, false);
-    set_n(f, false);
+    update_flags(state, DMG_FLAG_Z, DMG_FLAG_C);
 }
 
-static DMG_INLINE void jr_c_n(DMGState *state) {
-    if (get_c(&state->cpu.f)) {
-        jr_n(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 1;
+static DMG_INLINE void jr_c_n(DMGState *state, uint8_t n) {
+    if (get_c(state)) {
+        jr_n(state, n);
     }
 }
 
@@ -220,107 +349,70 @@ static DMG_INLINE void ldd_a_hl(DMGState *state) {
 }
 
 static DMG_INLINE void ccf(DMGState *state) {
-    uint8_t *f = &state->cpu.f;
-    set_c(f, !get_c(f));
-    set_h(f, false);
-    set_n(f, false);
+    update_flags(state, DMG_FLAG_Z, get_c(state) ? 0x00 : DMG_FLAG_C);
 }
 
 static DMG_INLINE void halt(DMGState *state) {
-    // TODO: real interrupts
-    state->cpu.halted = true;
-    state->cpu.halt_flags = state->mmu.io[DMG_IO_IF];
+    // With IME clear and an interrupt already pending HALT does not halt at
+    // all, it trips the HALT bug instead
+    if (!state->cpu.ime && dmg_irq_pending(state)) {
+        state->cpu.halt_bug = true;
+    } else {
+        state->cpu.halted = true;
+    }
+    dmg_irq_update(state);
 }
 
 static DMG_INLINE void add_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
-    uint16_t tmp = *a + r;
-    set_h(f, ((*a & 0x0F) + (r & 0x0F)) > 0x0F);
-    set_c(f, tmp > *a);
+    uint16_t tmp = (uint16_t) (*a + r);
+    defer_flags(state, DMG_FLAGS_ADD, *a, r, tmp);
     *a = (uint8_t) (tmp & 0xFF);
-    set_z(f, *a == 0x00);
-    set_n(f, false);
 }
 
 static DMG_INLINE void adc_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
-    uint16_t tmp = *a + r + get_c(f);
-    set_h(f, ((*a & 0x0F) + (r & 0x0F) + get_c(f)) > 0x0F);
-    set_c(f, tmp > 0xFF);
+    uint16_t tmp = (uint16_t) (*a + r + get_c(state));
+    defer_flags(state, DMG_FLAGS_ADD, *a, r, tmp);
     *a = (uint8_t) (tmp & 0xFF);
-    set_z(f, *a == 0x00);
-    set_n(f, false);
 }
 
 static DMG_INLINE void sub_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
-    set_h(f, (*a & 0x0F) < (r & 0x0F));
-    set_c(f, *a < r);
-    *a -= r;
-    set_z(f, *a == 0x00);
-    set_n(f, true);
+    uint16_t tmp = (uint16_t) (*a - r);
+    defer_flags(state, DMG_FLAGS_SUB, *a, r, tmp);
+    *a = (uint8_t) (tmp & 0xFF);
 }
 
-static DMG_INLINE void suba(DMGState *state) {
-    assert(false);
-    // TODO: This is sketchy. Logic from Gambatte
-    uint8_t *f = &state->cpu.f;
-    state->cpu.a = 0;
-    set_z(f, true);
-    set_n(f, true);
-}
 
 static DMG_INLINE void sbc_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
-    uint16_t tmp = *a - r - get_c(f);
-    set_h(f, (*a & 0x0F) < (r & 0x0F));
-    set_c(f, *a < r + get_c(f));
-    *a = (uint8_t) tmp;
-    set_z(f, *a == 0x00);
-    set_n(f, true);
+    uint16_t tmp = (uint16_t) (*a - r - get_c(state));
+    defer_flags(state, DMG_FLAGS_SUB, *a, r, tmp);
+    *a = (uint8_t) (tmp & 0xFF);
 }
 
 static DMG_INLINE void and_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
     *a &= r;
-    set_n(f, false);
-    set_h(f, true);
-    set_c(f, false);
-    set_z(f, *a == 0x00);
+    set_flags(state, *a == 0x00, false, true, false);
 }
 
 static DMG_INLINE void xor_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
     *a ^= r;
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, false);
-    set_z(f, *a == 0x00);
+    set_flags(state, *a == 0x00, false, false, false);
 }
 
 static DMG_INLINE void or_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t *a = &state->cpu.a;
     *a |= r;
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, false);
-    set_z(f, *a == 0x00);
+    set_flags(state, *a == 0x00, false, false, false);
 }
 
 static DMG_INLINE void cp_r(DMGState *state, uint8_t r) {
-    uint8_t *f = &state->cpu.f;
-    uint8_t *a = &state->cpu.a;
-    set_h(f, (*a & 0x0F) < (r & 0x0F));
-    set_c(f, *a < r);
-    set_z(f, *a == r);
-    set_n(f, true);
+    uint8_t a = state->cpu.a;
+    defer_flags(state, DMG_FLAGS_SUB, a, r, (uint16_t) (a - r));
 }
 
 static DMG_INLINE uint16_t pop16(DMGState *state) {
@@ -336,22 +428,19 @@ static DMG_INLINE void ret(DMGState *state) {
 
 static DMG_INLINE void ret_nz(DMGState *state) {
     state->cycles += 4;
-    if (!get_z(&state->cpu.f)) {
+    if (!get_z(state)) {
         ret(state);
     }
 }
 
-static DMG_INLINE void jp_nn(DMGState *state) {
+static DMG_INLINE void jp_nn(DMGState *state, uint16_t nn) {
     state->cycles += 4;
-    state->cpu.pc = read16_pc(state);
+    state->cpu.pc = nn;
 }
 
-static DMG_INLINE void jp_nz(DMGState *state) {
-    if (!get_z(&state->cpu.f)) {
-        jp_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void jp_nz(DMGState *state, uint16_t nn) {
+    if (!get_z(state)) {
+        jp_nn(state, nn);
     }
 }
 
@@ -360,17 +449,14 @@ static DMG_INLINE void push16(DMGState *state, uint16_t bytes) {
     write16(state, state->cpu.sp, bytes);
 }
 
-static DMG_INLINE void call_nn(DMGState *state) {
-    push16(state, (uint16_t) (state->cpu.pc + 2));
-    jp_nn(state);
+static DMG_INLINE void call_nn(DMGState *state, uint16_t nn) {
+    push16(state, state->cpu.pc);
+    jp_nn(state, nn);
 }
 
-static DMG_INLINE void call_nz(DMGState *state) {
-    if (!get_z(&state->cpu.f)) {
-        call_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void call_nz(DMGState *state, uint16_t nn) {
+    if (!get_z(state)) {
+        call_nn(state, nn);
     }
 }
 
@@ -382,48 +468,37 @@ static DMG_INLINE void rst(DMGState *state, uint8_t offset) {
 
 static DMG_INLINE void ret_z(DMGState *state) {
     state->cycles += 4;
-    if (get_z(&state->cpu.f)) {
+    if (get_z(state)) {
         ret(state);
     }
 }
 
-static DMG_INLINE void jp_z(DMGState *state) {
-    if (get_z(&state->cpu.f)) {
-        jp_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void jp_z(DMGState *state, uint16_t nn) {
+    if (get_z(state)) {
+        jp_nn(state, nn);
     }
 }
 
 static DMG_INLINE void rlc_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = *r >> 7;
     *r = (*r << 1) | carry;
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void rrc_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = (uint8_t) (*r & 0x01);
     *r = (*r >> 1) | (carry << 7);
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void rlca(DMGState *state) {
     rlc_r(state, &state->cpu.a);
-    set_z(&state->cpu.f, false); // This is a contentious line. Gambatte also sets Z to false in the RXXA instrs.
+    state->cpu.f &= ~DMG_FLAG_Z; // This is a contentious line. Gambatte also sets Z to false in the RXXA instrs.
 }
 
 static DMG_INLINE void rrca(DMGState *state) {
     rrc_r(state, &state->cpu.a);
-    set_z(&state->cpu.f, false);
+    state->cpu.f &= ~DMG_FLAG_Z;
 }
 
 static DMG_INLINE void rlc_mem_hl(DMGState *state) {
@@ -439,33 +514,25 @@ static DMG_INLINE void rrc_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void rl_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = *r >> 7;
-    *r = (*r << 1) | get_c(f);
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    *r = (*r << 1) | get_c(state);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void rr_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = (uint8_t) (*r & 0x01);
-    *r = (*r >> 1) | (get_c(f) << 7);
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    *r = (*r >> 1) | (get_c(state) << 7);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void rla(DMGState *state) {
     rl_r(state, &state->cpu.a);
-    set_z(&state->cpu.f, false);
+    state->cpu.f &= ~DMG_FLAG_Z;
 }
 
 static DMG_INLINE void rra(DMGState *state) {
     rr_r(state, &state->cpu.a);
-    set_z(&state->cpu.f, false);
+    state->cpu.f &= ~DMG_FLAG_Z;
 }
 
 static DMG_INLINE void rl_mem_hl(DMGState *state) {
@@ -481,13 +548,9 @@ static DMG_INLINE void rr_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void sla_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = *r >> 7;
     *r <<= 1;
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void sla_mem_hl(DMGState *state) {
@@ -497,13 +560,9 @@ static DMG_INLINE void sla_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void sra_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = (uint8_t) (*r &  0x01);
     *r = (uint8_t) ((*r >> 1) | (*r & 0x80));
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void sra_mem_hl(DMGState *state) {
@@ -513,12 +572,8 @@ static DMG_INLINE void sra_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void swap_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     *r = (uint8_t) ((*r >> 4) | ((*r & 0xF) << 4));
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, false);
+    set_flags(state, *r == 0x00, false, false, false);
 }
 
 static DMG_INLINE void swap_mem_hl(DMGState *state) {
@@ -528,13 +583,9 @@ static DMG_INLINE void swap_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void srl_r(DMGState *state, uint8_t *r) {
-    uint8_t *f = &state->cpu.f;
     uint8_t carry = (uint8_t) (*r & 0x01);
     *r >>= 1;
-    set_z(f, *r == 0x00);
-    set_n(f, false);
-    set_h(f, false);
-    set_c(f, carry);
+    set_flags(state, *r == 0x00, false, false, carry);
 }
 
 static DMG_INLINE void srl_mem_hl(DMGState *state) {
@@ -544,10 +595,7 @@ static DMG_INLINE void srl_mem_hl(DMGState *state) {
 }
 
 static DMG_INLINE void bit_r(DMGState *state, uint8_t byte, uint8_t n) {
-    uint8_t *f = &state->cpu.f;
-    set_z(f, !get_bit(&byte, n));
-    set_n(f, false);
-    set_h(f, true);
+    update_flags(state, DMG_FLAG_C, (uint8_t) ((!get_bit(&byte, n) << 7) | DMG_FLAG_H));
 }
 
 static DMG_INLINE void set_bit_mem_hl(DMGState *state, uint8_t n, bool value) {
@@ -556,84 +604,84 @@ static DMG_INLINE void set_bit_mem_hl(DMGState *state, uint8_t n, bool value) {
     write8(state, state->cpu.hl, tmp);
 }
 
-static DMG_INLINE void call_z(DMGState *state) {
-    if (get_z(&state->cpu.f)) {
-        call_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void call_z(DMGState *state, uint16_t nn) {
+    if (get_z(state)) {
+        call_nn(state, nn);
     }
 }
 
 static DMG_INLINE void ret_nc(DMGState *state) {
     state->cycles += 4;
-    if (!get_c(&state->cpu.f)) {
+    if (!get_c(state)) {
         ret(state);
     }
 }
 
-static DMG_INLINE void jp_nc(DMGState *state) {
-    if (!get_c(&state->cpu.f)) {
-        jp_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void jp_nc(DMGState *state, uint16_t nn) {
+    if (!get_c(state)) {
+        jp_nn(state, nn);
     }
 }
 
-static DMG_INLINE void call_nc(DMGState *state) {
-    if (!get_c(&state->cpu.f)) {
-        call_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void call_nc(DMGState *state, uint16_t nn) {
+    if (!get_c(state)) {
+        call_nn(state, nn);
     }
 }
 
 static DMG_INLINE void ret_c(DMGState *state) {
     state->cycles += 4;
-    if (get_c(&state->cpu.f)) {
+    if (get_c(state)) {
         ret(state);
     }
 }
 
 static DMG_INLINE void reti(DMGState *state) {
     ret(state);
-    // TODO: real interrupt handler
+    // Unlike EI, no delay
     state->cpu.ime = true;
+    dmg_irq_update(state);
 }
 
-static DMG_INLINE void jp_c(DMGState *state) {
-    if (get_c(&state->cpu.f)) {
-        jp_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void ei(DMGState *state) {
+    state->cpu.ei = true;
+    dmg_irq_update(state);
+}
+
+static DMG_INLINE void di(DMGState *state) {
+    state->cpu.ime = false;
+    state->cpu.ei = false;
+    dmg_irq_update(state);
+}
+
+static DMG_INLINE void jp_c(DMGState *state, uint16_t nn) {
+    if (get_c(state)) {
+        jp_nn(state, nn);
     }
 }
 
-static DMG_INLINE void call_c(DMGState *state) {
-    if (get_c(&state->cpu.f)) {
-        call_nn(state);
-    } else {
-        state->cycles += 4;
-        state->cpu.pc += 2;
+static DMG_INLINE void call_c(DMGState *state, uint16_t nn) {
+    if (get_c(state)) {
+        call_nn(state, nn);
     }
 }
 
-static DMG_INLINE uint16_t sp_plus_n(DMGState *state) {
-    // TODO: Unimplemented
-    assert(false);
+static DMG_INLINE uint16_t sp_plus_n(DMGState *state, uint8_t n) {
+    uint16_t sp = state->cpu.sp;
+    uint16_t offset = (uint16_t) (int8_t) n;
+    uint16_t tmp = (uint16_t) (sp + offset);
+    set_flags(state, false, false, ((sp ^ offset ^ tmp) & 0x10) != 0x00, ((sp ^ offset ^ tmp) & 0x100) != 0x00);
+    return tmp;
 }
 
-static DMG_INLINE void add_sp_n(DMGState *state) {
-    state->cycles += 4;
-    state->cpu.sp = sp_plus_n(state);
+static DMG_INLINE void add_sp_n(DMGState *state, uint8_t n) {
+    state->cycles += 8;
+    state->cpu.sp = sp_plus_n(state, n);
 }
 
-static DMG_INLINE void ldhl_sp_n(DMGState *state) {
+static DMG_INLINE void ldhl_sp_n(DMGState *state, uint8_t n) {
     state->cycles += 4;
-    state->cpu.hl = sp_plus_n(state);
+    state->cpu.hl = sp_plus_n(state, n);
 }
 
 static DMG_INLINE void ld_sp_hl(DMGState *state) {
@@ -641,2104 +689,996 @@ static DMG_INLINE void ld_sp_hl(DMGState *state) {
     state->cpu.sp = state->cpu.hl;
 }
 
-static DMG_INLINE void service_interrupts(DMGState *state) {
+/**
+ * Runs one instruction from its opcode with PC already past it
+ */
+static void execute(DMGState *state, uint8_t opcode);
+
+// Vector of the highest priority interrupt in an IF & IE mask
+static const uint8_t VECTORS[32] = {
+        0x00, 0x40, 0x48, 0x40, 0x50, 0x40, 0x48, 0x40, 0x58, 0x40, 0x48, 0x40, 0x50, 0x40, 0x48, 0x40,
+        0x60, 0x40, 0x48, 0x40, 0x50, 0x40, 0x48, 0x40, 0x58, 0x40, 0x48, 0x40, 0x50, 0x40, 0x48, 0x40,
+};
+
+/**
+ * Slow path of ready(), taken only while state->cpu.irq is set
+ */
+static bool service_interrupts(DMGState *state) {
     DMGCpu *cpu = &state->cpu;
     DMGMmu *mmu = &state->mmu;
 
-    // TODO: real interrupts
     if (cpu->halted) {
         state->cycles += 4;
-        if (cpu->halt_flags != state->mmu.io[DMG_IO_IF]) {
-            cpu->halted = false;
+        if (!dmg_irq_pending(state)) {
+            if (state->cycles < state->sched.deadline) {
+                // Only a scheduled event can change IF now, so skip to the
+                // deadline in the same 4 cycle steps rather than spinning
+                state->cycles += (size_t) ((state->sched.deadline - state->cycles + 3) & ~(uint64_t) 3);
+            }
+            return false;
         }
+        // Wakes whether or not IME lets the interrupt through
+        cpu->halted = false;
     }
-    if (!cpu->ime) {
-        return;
-    }
-    uint8_t ints = mmu->io[DMG_IO_IF] & mmu->io[DMG_IO_IE];
-    if (ints == 0x00) {
-        return;
-    }
-    if (ints & 0x01) { // vblank
-        rst(state, 0x40);
-        mmu->io[DMG_IO_IF] ^= 0x01;
-        cpu->ime = false;
-        return;
-    }
-    if (ints & 0x02) { // lcd stat
-        rst(state, 0x48);
-        mmu->io[DMG_IO_IF] ^= 0x02;
-        cpu->ime = false;
-        return;
-    }
-    if (ints & 0x04) { // timer
-        rst(state, 0x50);
-        mmu->io[DMG_IO_IF] ^= 0x04;
-        cpu->ime = false;
-        return;
+    if (cpu->halt_bug) {
+        // The opcode after HALT is fetched without PC moving past it, so its
+        // first byte is read twice
+        cpu->halt_bug = false;
+        execute(state, read8(state, cpu->pc));
     }
-    if (ints & 0x08) { // serial
-        rst(state, 0x58);
-        mmu->io[DMG_IO_IF] ^= 0x08;
-        cpu->ime = false;
-        return;
+    if (cpu->ei) {
+        // IME turns on after the instruction following EI, which has to run
+        // on its own if an interrupt is waiting for it. A DI there cancels.
+        if (dmg_irq_pending(state) && !cpu->halted) {
+            execute(state, read8_pc(state));
+        }
+        if (cpu->ei) {
+            cpu->ei = false;
+            cpu->ime = true;
+        }
     }
-    if (ints & 0x10) { // joypad
-        rst(state, 0x60);
-        mmu->io[DMG_IO_IF] ^= 0x10;
+    uint8_t ints = dmg_irq_pending(state);
+    if (cpu->ime && ints) {
+        mmu->io[DMG_IO_IF] ^= (uint8_t) (ints & -ints);
         cpu->ime = false;
-        return;
+        if (cpu->halt_bug) {
+            // EI; HALT with an interrupt pending returns to the HALT
+            cpu->halt_bug = false;
+            cpu->pc -= 1;
+        }
+        // Two idle M-cycles, then the push and jump of an RST
+        state->cycles += 8;
+        rst(state, VECTORS[ints]);
     }
+    dmg_irq_update(state);
+    return !cpu->halted;
 }
 
-void dmg_cpu_run(DMGState *state, size_t cycles) {
-    DMGCpu *cpu = &state->cpu;
+/**
+ * Checks for interrupts and HALT before the next instruction. Returns false if
+ * the CPU is halted and the run loop has to hand control back to the caller.
+ */
+static DMG_INLINE bool ready(DMGState *state) {
+    return !state->cpu.irq || service_interrupts(state);
+}
 
-    service_interrupts(state);
+// The interpreting engines fetch operands as they go
+#define DMG_IMM8() read8_pc(state)
+#define DMG_IMM16() read16_pc(state)
+
+/**
+ * Reference engine: a plain switch over the opcode table.
+ */
+static DMG_INLINE void step_cb_switch(DMGState *state, uint8_t opcode) {
+    DMGCpu *cpu = &state->cpu;
+    switch (opcode) {
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) case code: __VA_ARGS__ break;
+#include <dmg/opcodes.h>
+        default:
+            assert(false);
+    }
+}
 
+static DMG_INLINE void step_switch(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
     switch (read8_pc(state)) {
+#define DMG_DISPATCH_CB(opcode) step_cb_switch(state, opcode)
+#define DMG_OP(code, name, length, ...) case code: __VA_ARGS__ break;
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+#undef DMG_DISPATCH_CB
+        default:
+            assert(false);
+    }
+}
 
-        case 0x00: // NOP
+static void run_switch(DMGState *state) {
+    // Always execute at least one instruction so a zero budget still makes progress
+    do {
+        if (!ready(state)) {
             break;
+        }
+        step_switch(state);
+    } while (state->cycles < state->sched.deadline);
+}
 
-        case 0x01: // LD BC, NN
-            cpu->bc = read16_pc(state);
-            break;
+/**
+ * Portable threaded engine: one handler function per opcode, dispatched
+ * through a table.
+ */
+typedef void (*DMGOpHandler)(DMGState *state);
 
-        case 0x02: // LD (BC), A
-            write8(state, cpu->bc, cpu->a);
-            break;
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) \
+    static void cb_op_##code(DMGState *state) { DMGCpu *cpu = &state->cpu; (void) cpu; __VA_ARGS__ }
+#include <dmg/opcodes.h>
 
-        case 0x03: // INC BC
-            inc_rr(state, &cpu->bc);
-            break;
+static const DMGOpHandler CB_HANDLERS[256] = {
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) [code] = cb_op_##code,
+#include <dmg/opcodes.h>
+};
 
-        case 0x04: // INC B
-            inc_r(state, &cpu->b);
-            break;
+#define DMG_DISPATCH_CB(opcode) CB_HANDLERS[opcode](state)
+#define DMG_OP(code, name, length, ...) \
+    static void op_##code(DMGState *state) { DMGCpu *cpu = &state->cpu; (void) cpu; __VA_ARGS__ }
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+#undef DMG_DISPATCH_CB
 
-        case 0x05: // DEC B
-            dec_r(state, &cpu->b);
-            break;
+static const DMGOpHandler HANDLERS[256] = {
+#define DMG_OP(code, name, length, ...) [code] = op_##code,
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+};
 
-        case 0x06: // LD B, N
-            cpu->b = read8_pc(state);
-            break;
+static void execute(DMGState *state, uint8_t opcode) {
+    HANDLERS[opcode](state);
+}
 
-        case 0x07: // RLCA
-            rlca(state);
+static void run_table(DMGState *state) {
+    do {
+        if (!ready(state)) {
             break;
+        }
+        HANDLERS[read8_pc(state)](state);
+    } while (state->cycles < state->sched.deadline);
+}
+
+#if DMG_HAS_COMPUTED_GOTO
+/**
+ * Direct threaded engine: every handler ends in its own indirect jump to the
+ * next one, giving the branch predictor one jump site per opcode instead of
+ * the single shared one in the switch.
+ */
+static void run_threaded(DMGState *state) {
+    static const void *const LABELS[256] = {
+#define DMG_OP(code, name, length, ...) [code] = &&op_##code,
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+    };
+    static const void *const CB_LABELS[256] = {
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) [code] = &&cb_op_##code,
+#include <dmg/opcodes.h>
+    };
+    DMGCpu *cpu = &state->cpu;
 
-        case 0x08: // LD (NN), SP
-            write16(state, read16_pc(state), cpu->sp);
-            break;
+#define DMG_NEXT() \
+    do { \
+        if (state->cycles >= state->sched.deadline || !ready(state)) { \
+            return; \
+        } \
+        goto *LABELS[read8_pc(state)]; \
+    } while (0)
 
-        case 0x09: // ADD HL, BC
-            add_hl_rr(state, &cpu->bc);
+    if (!ready(state)) {
+        return;
+    }
+    goto *LABELS[read8_pc(state)];
+
+#define DMG_DISPATCH_CB(opcode) goto *CB_LABELS[opcode]
+#define DMG_OP(code, name, length, ...) op_##code: __VA_ARGS__ DMG_NEXT();
+#define DMG_CB_OP(code, name, length, ...) cb_op_##code: __VA_ARGS__ DMG_NEXT();
+#include <dmg/opcodes.h>
+#undef DMG_DISPATCH_CB
+#undef DMG_NEXT
+}
+#endif
+
+#undef DMG_IMM8
+#undef DMG_IMM16
+
+/**
+ * Block engine: straight-line runs of instructions are decoded once into a
+ * DMGBlock and replayed from the cache with their operands and fetch cost
+ * already resolved. Handlers take the predecoded instruction.
+ */
+#define DMG_IMM8() ((uint8_t) insn->operand)
+#define DMG_IMM16() (insn->operand)
+#define DMG_DISPATCH_CB(opcode)
+
+#define DMG_OP(code, name, length, ...) \
+    static void block_op_##code(DMGState *state, const DMGInsn *insn) { DMGCpu *cpu = &state->cpu; (void) cpu; __VA_ARGS__ }
+#define DMG_CB_OP(code, name, length, ...) \
+    static void block_cb_op_##code(DMGState *state, const DMGInsn *insn) { DMGCpu *cpu = &state->cpu; (void) cpu; __VA_ARGS__ }
+#include <dmg/opcodes.h>
+
+#undef DMG_DISPATCH_CB
+#undef DMG_IMM8
+#undef DMG_IMM16
+
+static const DMGInsnHandler BLOCK_HANDLERS[256] = {
+#define DMG_OP(code, name, length, ...) [code] = block_op_##code,
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+};
+
+static const DMGInsnHandler BLOCK_CB_HANDLERS[256] = {
+#define DMG_OP(code, name, length, ...)
+#define DMG_CB_OP(code, name, length, ...) [code] = block_cb_op_##code,
+#include <dmg/opcodes.h>
+};
+
+static const uint8_t LENGTHS[256] = {
+#define DMG_OP(code, name, length, ...) [code] = length,
+#define DMG_CB_OP(code, name, length, ...)
+#include <dmg/opcodes.h>
+};
+
+static DMG_INLINE bool ends_block(uint8_t opcode) {
+    switch (opcode) {
+        case 0x10: // STOP
+        case 0x18: // JR N
+        case 0x20: // JR NZ, N
+        case 0x28: // JR Z, N
+        case 0x30: // JR NC, N
+        case 0x38: // JR C, N
+        case 0x76: // HALT
+        case 0xC0: // RET NZ
+        case 0xC2: // JP NZ, NN
+        case 0xC3: // JP NN
+        case 0xC4: // CALL NZ, NN
+        case 0xC7: // RST $00
+        case 0xC8: // RET Z
+        case 0xC9: // RET
+        case 0xCA: // JP Z, NN
+        case 0xCC: // CALL Z, NN
+        case 0xCD: // CALL NN
+        case 0xCF: // RST $08
+        case 0xD0: // RET NC
+        case 0xD2: // JP NC, NN
+        case 0xD4: // CALL NC, NN
+        case 0xD7: // RST $10
+        case 0xD8: // RET C
+        case 0xD9: // RETI
+        case 0xDA: // JP C, NN
+        case 0xDC: // CALL C, NN
+        case 0xDF: // RST $18
+        case 0xE7: // RST $20
+        case 0xE9: // JP HL
+        case 0xEF: // RST $28
+        case 0xF3: // DI
+        case 0xF7: // RST $30
+        case 0xFB: // EI
+        case 0xFF: // RST $38
+            return true;
+        default:
             break;
-
+    }
+    return false;
+}
+
+/**
+ * Instructions that leave memory, the stack, interrupts and control flow
+ * alone: register moves, ALU ops, BIT and loads from memory
+ */
+static DMG_INLINE bool pure(const DMGInsn *insn) {
+    uint8_t opcode = insn->opcode;
+    if (opcode == 0xCB) {
+        // BIT n, (HL) only reads, the other ops on (HL) write it back
+        return (insn->operand & 0x07) != 0x06 || (insn->operand & 0xC0) == 0x40;
+    }
+    if (opcode >= 0x40 && opcode <= 0xBF) {
+        // LD (HL), r and HALT are the only ones with side effects
+        return opcode < 0x70 || opcode > 0x77;
+    }
+    if (opcode < 0x40 && (opcode & 0x07) >= 0x04 && (opcode & 0x07) <= 0x06) {
+        // INC r, DEC r and LD r, N unless r is (HL)
+        return (opcode & 0xF8) != 0x30;
+    }
+    switch (opcode) {
+        case 0x00: // NOP
+        case 0x03: // INC BC
+        case 0x07: // RLCA
         case 0x0A: // LD A, (BC)
-            cpu->a = read8(state, cpu->bc);
-            break;
-
         case 0x0B: // DEC BC
-            dec_rr(state, &cpu->bc);
-            break;
-
-        case 0x0C: // INC C
-            inc_r(state, &cpu->c);
-            break;
-
-        case 0x0D: // DEC C
-            dec_r(state, &cpu->c);
-            break;
-
-        case 0x0E: // LD C, N
-            cpu->c = read8_pc(state);
-            break;
-
         case 0x0F: // RRCA
-            rrca(state);
-            break;
-
-        case 0x10: // STOP
-            stop(state);
-            break;
-
-        case 0x11: // LD DE, NN
-            cpu->de = read16_pc(state);
-            break;
-
-        case 0x12: // LD (DE), A
-            write8(state, cpu->de, cpu->a);
-            break;
-
         case 0x13: // INC DE
-            inc_rr(state, &cpu->de);
-            break;
-
-        case 0x14: // INC D
-            inc_r(state, &cpu->d);
-            break;
-
-        case 0x15: // DEC D
-            dec_r(state, &cpu->d);
-            break;
-
-        case 0x16: // LD D, N
-            cpu->d = read8_pc(state);
-            break;
-
         case 0x17: // RLA
-            rla(state);
-            break;
-
-        case 0x18: // JR N
-            jr_n(state);
-            break;
-
-        case 0x19: // ADD HL, DE
-            add_hl_rr(state, &cpu->de);
-            break;
-
         case 0x1A: // LD A, (DE)
-            cpu->a = read8(state, cpu->de);
-            break;
-
         case 0x1B: // DEC DE
-            dec_rr(state, &cpu->de);
-            break;
-
-        case 0x1C: // INC E
-            inc_r(state, &cpu->e);
-            break;
-
-        case 0x1D: // DEC E
-            dec_r(state, &cpu->e);
-            break;
-
-        case 0x1E: // LD E, N
-            cpu->e = read8_pc(state);
-            break;
-
         case 0x1F: // RRA
-            rra(state);
-            break;
-
-        case 0x20: // JR NZ, N
-            jr_nz_n(state);
-            break;
-
-        case 0x21: // LD HL, NN
-            cpu->hl = read16_pc(state);
-            break;
-
-        case 0x22: // LDI (HL), A
-            ldi_hl_a(state);
-            break;
-
         case 0x23: // INC HL
-            inc_rr(state, &cpu->hl);
-            break;
-
-        case 0x24: // INC H
-            inc_r(state, &cpu->h);
-            break;
-
-        case 0x25: // DEC H
-            dec_r(state, &cpu->h);
-            break;
-
-        case 0x26: // LD H, N
-            cpu->h = read8_pc(state);
-            break;
-
         case 0x27: // DAA
-            daa(state);
-            break;
-
-        case 0x28: // JR Z, N
-            jr_z_n(state);
-            break;
-
-        case 0x29: // ADD HL, HL
-            add_hl_rr(state, &cpu->hl);
-            break;
-
         case 0x2A: // LDI A, (HL)
-            ldi_a_hl(state);
-            break;
-
         case 0x2B: // DEC HL
-            dec_rr(state, &cpu->hl);
-            break;
-
-        case 0x2C: // INC L
-            inc_r(state, &cpu->l);
-            break;
-
-        case 0x2D: // DEC L
-            dec_r(state, &cpu->l);
-            break;
-
-        case 0x2E: // LD L, N
-            cpu->l = read8_pc(state);
-            break;
-
         case 0x2F: // CPL
-            cpl(state);
-            break;
-
-        case 0x30: // JR NC, N
-            jr_nc_n(state);
-            break;
-
-        case 0x31: // LD SP, NN
-            cpu->sp = read16_pc(state);
-            break;
-
-        case 0x32: // LDD (HL), A
-            ldd_hl_a(state);
-            break;
-
-        case 0x33: // INC SP
-            inc_rr(state, &cpu->sp);
-            break;
-
-        case 0x34: // INC (HL)
-            inc_mem_hl(state);
-            break;
-
-        case 0x35: // DEC (HL)
-            dec_mem_hl(state);
-            break;
-
-        case 0x36: // LD (HL), N
-            write8(state, cpu->hl, read8_pc(state));
-            break;
-
         case 0x37: // SCF
-            scf(state);
-            break;
-
-        case 0x38: // JR C, N
-            jr_c_n(state);
-            break;
-
-        case 0x39: // ADD HL, SP
-            add_hl_rr(state, &cpu->sp);
-            break;
-
         case 0x3A: // LDD A, (HL)
-            ldd_a_hl(state);
-            break;
-
-        case 0x3B: // DEC SP
-            dec_rr(state, &cpu->sp);
-            break;
-
-        case 0x3C: // INC A
-            inc_r(state, &cpu->a);
-            break;
-
-        case 0x3D: // DEC A
-            dec_r(state, &cpu->a);
-            break;
-
-        case 0x3E: // LD A, N
-            cpu->a = read8_pc(state);
-            break;
-
         case 0x3F: // CCF
-            ccf(state);
-            break;
-
-        case 0x40: // LD B, B
-            cpu->b = cpu->b;
-            break;
-
-        case 0x41: // LD B, C
-            cpu->b = cpu->c;
-            break;
-
-        case 0x42: // LD B, D
-            cpu->b = cpu->d;
-            break;
-
-        case 0x43: // LD B, E
-            cpu->b = cpu->e;
-            break;
-
-        case 0x44: // LD B, H
-            cpu->b = cpu->h;
-            break;
-
-        case 0x45: // LD B, L
-            cpu->b = cpu->l;
-            break;
-
-        case 0x46: // LD B, (HL)
-            cpu->b = read8(state, cpu->hl);
-            break;
-
-        case 0x47: // LD B, A
-            cpu->b = cpu->a;
-            break;
-
-        case 0x48: // LD C, B
-            cpu->c = cpu->b;
-            break;
-
-        case 0x49: // LD C, C
-            cpu->c = cpu->c;
-            break;
-
-        case 0x4A: // LD C, D
-            cpu->c = cpu->d;
-            break;
-
-        case 0x4B: // LD C, E
-            cpu->c = cpu->e;
-            break;
-
-        case 0x4C: // LD C, H
-            cpu->c = cpu->h;
-            break;
-
-        case 0x4D: // LD C, L
-            cpu->c = cpu->l;
-            break;
-
-        case 0x4E: // LD C, (HL)
-            cpu->c = read8(state, cpu->hl);
-            break;
-
-        case 0x4F: // LD C, A
-            cpu->c = cpu->a;
-            break;
-
-        case 0x50: // LD D, B
-            cpu->d = cpu->b;
-            break;
-
-        case 0x51: // LD D, C
-            cpu->d = cpu->c;
-            break;
-
-        case 0x52: // LD D, D
-            cpu->d = cpu->d;
-            break;
-
-        case 0x53: // LD D, E
-            cpu->d = cpu->e;
-            break;
-
-        case 0x54: // LD D, H
-            cpu->d = cpu->h;
-            break;
-
-        case 0x55: // LD D, L
-            cpu->d = cpu->l;
-            break;
-
-        case 0x56: // LD D, (HL)
-            cpu->d = read8(state, cpu->hl);
-            break;
-
-        case 0x57: // LD D, A
-            cpu->d = cpu->a;
-            break;
-
-        case 0x58: // LD E, B
-            cpu->e = cpu->b;
-            break;
-
-        case 0x59: // LD E, C
-            cpu->e = cpu->c;
-            break;
-
-        case 0x5A: // LD E, D
-            cpu->e = cpu->d;
-            break;
-
-        case 0x5B: // LD E, E
-            cpu->e = cpu->e;
-            break;
-
-        case 0x5C: // LD E, H
-            cpu->e = cpu->h;
-            break;
-
-        case 0x5D: // LD E, L
-            cpu->e = cpu->l;
-            break;
-
-        case 0x5E: // LD E, (HL)
-            cpu->e = read8(state, cpu->hl);
-            break;
-
-        case 0x5F: // LD E, A
-            cpu->e = cpu->a;
-            break;
-
-        case 0x60: // LD H, B
-            cpu->h = cpu->b;
-            break;
-
-        case 0x61: // LD H, C
-            cpu->h = cpu->c;
-            break;
-
-        case 0x62: // LD H, D
-            cpu->h = cpu->d;
-            break;
-
-        case 0x63: // LD H, E
-            cpu->h = cpu->e;
-            break;
-
-        case 0x64: // LD H, H
-            cpu->h = cpu->h;
+        case 0xC6: // ADD N
+        case 0xCE: // ADC N
+        case 0xD6: // SUB N
+        case 0xDE: // SBC N
+        case 0xE6: // AND N
+        case 0xEE: // XOR N
+        case 0xF0: // LDH A, (N)
+        case 0xF2: // LD A, (C)
+        case 0xF6: // OR N
+        case 0xFA: // LD A, (NN)
+        case 0xFE: // CP N
+            return true;
+        default:
             break;
-
-        case 0x65: // LD H, L
-            cpu->h = cpu->l;
+    }
+    return false;
+}
+
+/**
+ * Whether `block` may be an idle loop: nothing but pure instructions ending
+ * in a jump back to its own start, like a poll of LY or of a flag in RAM.
+ * Whether an iteration really changes nothing is checked as it runs.
+ */
+static bool idle_candidate(const DMGBlock *block) {
+    uint16_t pc = block->start;
+    for (uint8_t i = 0; i + 1 < block->count; i++) {
+        if (!pure(&block->insns[i])) {
+            return false;
+        }
+        pc += block->insns[i].length;
+    }
+    const DMGInsn *last = &block->insns[block->count - 1];
+    uint16_t next = (uint16_t) (pc + last->length);
+    switch (last->opcode) {
+        case 0x18: // JR N
+        case 0x20: // JR NZ, N
+        case 0x28: // JR Z, N
+        case 0x30: // JR NC, N
+        case 0x38: // JR C, N
+            return (uint16_t) (next + (int8_t) last->operand) == block->start;
+        case 0xC2: // JP NZ, NN
+        case 0xC3: // JP NN
+        case 0xCA: // JP Z, NN
+        case 0xD2: // JP NC, NN
+        case 0xDA: // JP C, NN
+            return last->operand == block->start;
+        default:
             break;
+    }
+    return false;
+}
 
-        case 0x66: // LD H, (HL)
-            cpu->h = read8(state, cpu->hl);
-            break;
+/**
+ * Identifies the memory a block at `pc` is decoded from. Returns false for
+ * regions that are never cached (VRAM, cart RAM, echo RAM, OAM and IO), which
+ * are interpreted instead. `limit` is the end of the region a block may not
+ * run past.
+ */
+static DMG_INLINE bool block_key(DMGState *state, uint16_t pc, uint32_t *key, uint32_t *limit) {
+    DMGMmu *mmu = &state->mmu;
+    uint32_t bank;
+    if (pc < 0x0100 && mmu->io[DMG_IO_BIOS] == 0x00) {
+        bank = DMG_BLOCK_BANK_BIOS;
+        *limit = 0x0100;
+    } else if (pc < 0x4000) {
+        bank = state->cart.bank0;
+        *limit = 0x4000;
+    } else if (pc < 0x8000) {
+        bank = state->cart.bankx;
+        *limit = 0x8000;
+    } else if (pc >= 0xC000 && pc < 0xD000) {
+        bank = DMG_BLOCK_BANK_WRAM;
+        *limit = 0xD000;
+    } else if (pc >= 0xD000 && pc < 0xE000) {
+        bank = DMG_BLOCK_BANK_WRAM + (mmu->io[DMG_IO_SVBK] & 0x07);
+        *limit = 0xE000;
+    } else if (pc >= 0xFF80 && pc < 0xFFFF) {
+        bank = DMG_BLOCK_BANK_HRAM;
+        *limit = 0xFFFF;
+    } else {
+        return false;
+    }
+    *key = DMG_BLOCK_VALID | (bank << 16) | pc;
+    return true;
+}
+
+/**
+ * Whether the block in `slot` is still one decoded from RAM line `line`
+ */
+static DMG_INLINE bool from_line(const DMGBlockCache *cache, uint16_t slot, uint16_t line) {
+    const DMGBlock *block = &cache->blocks[slot];
+    return block->key && block->start >= 0x8000 && (block->start >> DMG_BLOCK_LINE_BITS) <= line &&
+           (block->end >> DMG_BLOCK_LINE_BITS) >= line;
+}
+
+/**
+ * Adds `slot` to the blocks listed under `line`. A full list first drops its
+ * stale entries, and if none are it is marked as overflowing.
+ */
+static void list_block(DMGBlockCache *cache, uint16_t slot, uint16_t line) {
+    uint16_t *slots = cache->line_slots[line - DMG_BLOCK_RAM_LINES];
+    uint8_t *count = &cache->line_counts[line - DMG_BLOCK_RAM_LINES];
+    cache->code[line] = true;
+    if (*count > DMG_BLOCK_LINE_SLOTS) {
+        return;
+    }
+    for (uint8_t i = 0; i < *count; i++) {
+        if (slots[i] == slot) {
+            return;
+        }
+    }
+    if (*count == DMG_BLOCK_LINE_SLOTS) {
+        uint8_t kept = 0;
+        for (uint8_t i = 0; i < *count; i++) {
+            if (from_line(cache, slots[i], line)) {
+                slots[kept++] = slots[i];
+            }
+        }
+        *count = kept;
+    }
+    if (*count == DMG_BLOCK_LINE_SLOTS) {
+        *count = DMG_BLOCK_LINE_SLOTS + 1;
+        return;
+    }
+    slots[(*count)++] = slot;
+}
 
-        case 0x67: // LD H, A
-            cpu->h = cpu->a;
+static void decode_block(DMGState *state, DMGBlock *block, uint32_t key, uint32_t limit) {
+    DMGBlockCache *cache = &state->blocks;
+    uint16_t start = (uint16_t) key;
+    uint32_t pc = start;
+    uint8_t count = 0;
+    while (count < DMG_BLOCK_INSNS) {
+        uint8_t opcode = dmg_mmu_read(state, (uint16_t) pc);
+        uint8_t length = LENGTHS[opcode];
+        if (pc + length > limit) {
             break;
-
-        case 0x68: // LD L, B
-            cpu->l = cpu->b;
+        }
+        DMGInsn *insn = &block->insns[count++];
+        insn->length = length;
+        insn->opcode = opcode;
+        insn->cycles = (uint8_t) (length * 4);
+        insn->operand = 0;
+        if (opcode == 0xCB) {
+            // CB handlers take no operand, keep the second opcode byte there
+            insn->operand = dmg_mmu_read(state, (uint16_t) (pc + 1));
+            insn->handler = BLOCK_CB_HANDLERS[insn->operand];
+        } else {
+            insn->handler = BLOCK_HANDLERS[opcode];
+            if (length == 2) {
+                insn->operand = dmg_mmu_read(state, (uint16_t) (pc + 1));
+            } else if (length == 3) {
+                insn->operand = (uint16_t) (dmg_mmu_read(state, (uint16_t) (pc + 1)) |
+                                            (dmg_mmu_read(state, (uint16_t) (pc + 2)) << 8));
+            }
+        }
+        pc += length;
+        if (ends_block(opcode)) {
             break;
+        }
+    }
+    cache->epoch++;
+    block->key = count ? key : 0;
+    block->start = start;
+    block->end = (uint16_t) (pc - 1);
+    block->count = count;
+    block->hits = 0;
+    block->native = NULL;
+    block->idle = count && idle_candidate(block);
+
+    // Writes into RAM that holds cached code have to find the block again
+    if (count && start >= 0x8000) {
+        for (uint16_t line = start >> DMG_BLOCK_LINE_BITS; line <= block->end >> DMG_BLOCK_LINE_BITS; line++) {
+            list_block(cache, (uint16_t) (block - cache->blocks), line);
+        }
+    }
+}
 
-        case 0x69: // LD L, C
-            cpu->l = cpu->c;
-            break;
+static DMG_INLINE DMGBlock *lookup_block(DMGState *state, uint16_t pc) {
+    uint32_t key;
+    uint32_t limit;
+    if (!block_key(state, pc, &key, &limit)) {
+        return NULL;
+    }
+    DMGBlock *block = &state->blocks.blocks[(key * 2654435761u) >> (32 - DMG_BLOCK_CACHE_BITS)];
+    if (block->key != key) {
+        decode_block(state, block, key, limit);
+        if (block->count == 0) {
+            return NULL;
+        }
+    }
+    return block;
+}
+
+/**
+ * Block at pc after `prev` ran, through its link if that is still good,
+ * otherwise looked up and linked. Saves the key and hash lookup on the short
+ * blocks most loops are made of.
+ */
+static DMG_INLINE DMGBlock *next_block(DMGState *state, DMGBlock *prev) {
+    DMGBlockCache *cache = &state->blocks;
+    uint16_t pc = state->cpu.pc;
+    if (!prev) {
+        return lookup_block(state, pc);
+    }
+    int branched = pc != (uint16_t) (prev->end + 1);
+    if (prev->link_epochs[branched] == cache->epoch) {
+        DMGBlock *block = &cache->blocks[prev->links[branched]];
+        if (block->start == pc) {
+            return block;
+        }
+    }
+    DMGBlock *block = lookup_block(state, pc);
+    if (block) {
+        // After any decode, so the epoch is the one the link is good for
+        prev->links[branched] = (uint16_t) (block - cache->blocks);
+        prev->link_epochs[branched] = cache->epoch;
+    }
+    return block;
+}
 
-        case 0x6A: // LD L, D
-            cpu->l = cpu->d;
-            break;
+/**
+ * Drops the block in `slot` if it holds the byte at `address`, or lists it
+ * again under `line` if it is still from there. `*kept` counts the ones
+ * listed, including any past the end of the list.
+ */
+static DMG_INLINE void sift_block(DMGBlockCache *cache, uint16_t slot, uint16_t line, uint16_t address,
+                                  size_t *kept) {
+    if (!from_line(cache, slot, line)) {
+        return;
+    }
+    DMGBlock *block = &cache->blocks[slot];
+    if (block->start <= address && address <= block->end) {
+        block->key = 0;
+        cache->dirty = true;
+        cache->epoch++;
+        return;
+    }
+    if (*kept < DMG_BLOCK_LINE_SLOTS) {
+        cache->line_slots[line - DMG_BLOCK_RAM_LINES][*kept] = slot;
+    }
+    (*kept)++;
+}
 
-        case 0x6B: // LD L, E
-            cpu->l = cpu->e;
-            break;
+void dmg_cpu_invalidate(DMGState *state, uint16_t address) {
+    DMGBlockCache *cache = &state->blocks;
+    uint16_t line = address >> DMG_BLOCK_LINE_BITS;
+    if (line < DMG_BLOCK_RAM_LINES) {
+        return;
+    }
+    uint8_t *count = &cache->line_counts[line - DMG_BLOCK_RAM_LINES];
+    size_t kept = 0;
+    if (*count > DMG_BLOCK_LINE_SLOTS) {
+        // Too many to list, search the whole cache and list what survives
+        for (uint16_t slot = 0; slot < DMG_BLOCK_CACHE_SIZE; slot++) {
+            sift_block(cache, slot, line, address, &kept);
+        }
+    } else {
+        // Survivors are listed again in place, never past the one being read
+        const uint16_t *slots = cache->line_slots[line - DMG_BLOCK_RAM_LINES];
+        for (uint8_t i = 0; i < *count; i++) {
+            sift_block(cache, slots[i], line, address, &kept);
+        }
+    }
+    *count = (uint8_t) (kept > DMG_BLOCK_LINE_SLOTS ? DMG_BLOCK_LINE_SLOTS + 1 : kept);
+    cache->code[line] = kept != 0;
+}
+
+void dmg_cpu_invalidate_ram(DMGState *state) {
+    DMGBlockCache *cache = &state->blocks;
+    memset(cache->code, 0, sizeof(cache->code));
+    memset(cache->line_counts, 0, sizeof(cache->line_counts));
+    cache->dirty = true;
+    cache->epoch++;
+    for (size_t i = 0; i < DMG_BLOCK_CACHE_SIZE; i++) {
+        if (cache->blocks[i].start >= 0x8000) {
+            cache->blocks[i].key = 0;
+        }
+    }
+}
 
-        case 0x6C: // LD L, H
-            cpu->l = cpu->h;
+/**
+ * Replays a decoded block. Bails out between instructions if the budget runs
+ * out or an instruction changed memory the block came from.
+ */
+static DMG_INLINE void replay_block(DMGState *state, const DMGBlock *block) {
+    DMGCpu *cpu = &state->cpu;
+    DMGBlockCache *cache = &state->blocks;
+    uint64_t deadline = state->sched.deadline;
+    const DMGInsn *insn = block->insns;
+    const DMGInsn *last = insn + block->count;
+    cache->dirty = false;
+    do {
+        cpu->pc += insn->length;
+        state->cycles += insn->cycles;
+        insn->handler(state, insn);
+    } while (++insn < last && state->cycles < deadline && !cache->dirty);
+}
+
+/**
+ * Address `insn`, one of the pure instructions, reads with the registers in
+ * `cpu`, or -1 if it does not touch memory
+ */
+static DMG_INLINE int32_t read_address(const DMGCpu *cpu, const DMGInsn *insn) {
+    switch (insn->opcode) {
+        case 0x0A: // LD A, (BC)
+            return cpu->bc;
+        case 0x1A: // LD A, (DE)
+            return cpu->de;
+        case 0xF0: // LDH A, (N)
+            return 0xFF00 | (uint8_t) insn->operand;
+        case 0xF2: // LD A, (C)
+            return 0xFF00 | cpu->c;
+        case 0xFA: // LD A, (NN)
+            return insn->operand;
+        case 0xCB:
+            return (insn->operand & 0x07) == 0x06 ? cpu->hl : -1;
+        case 0x2A: // LDI A, (HL)
+        case 0x3A: // LDD A, (HL)
+            return cpu->hl;
+        default:
             break;
+    }
+    return (insn->opcode >= 0x40 && insn->opcode <= 0xBF && (insn->opcode & 0x07) == 0x06) ? cpu->hl : -1;
+}
+
+/**
+ * First cycle at which reading `address` may give a different value even
+ * though no event was dispatched. LY and STAT move on with the PPU, DIV and
+ * TIMA with the timer, anything else is only changed by the CPU itself or by
+ * an event.
+ */
+static DMG_INLINE uint64_t next_change(DMGState *state, int32_t address) {
+    if (address == 0xFF00 + DMG_IO_LY || address == 0xFF00 + DMG_IO_STAT) {
+        return state->ppu.next;
+    }
+    if (address == 0xFF00 + DMG_IO_DIV || address == 0xFF00 + DMG_IO_TIMA) {
+        return dmg_timer_next_change(state, (uint8_t) address);
+    }
+    return UINT64_MAX;
+}
 
-        case 0x6D: // LD L, L
-            cpu->l = cpu->l;
-            break;
+static DMG_INLINE bool same_registers(const DMGCpu *a, const DMGCpu *b) {
+    return a->pc == b->pc && a->sp == b->sp && a->af == b->af && a->bc == b->bc && a->de == b->de &&
+           a->hl == b->hl && a->flags_op == b->flags_op && a->flags_lhs == b->flags_lhs &&
+           a->flags_rhs == b->flags_rhs && a->flags_result == b->flags_result;
+}
 
-        case 0x6E: // LD L, (HL)
-            cpu->l = read8(state, cpu->hl);
-            break;
+/**
+ * Replays a block that may be an idle loop. If the iteration left every
+ * register as it found it, the next ones will do exactly the same until
+ * something they read changes, so as many whole iterations as end before that
+ * (or before the deadline) are skipped in one step.
+ */
+static void replay_idle(DMGState *state, const DMGBlock *block) {
+    DMGCpu *cpu = &state->cpu;
+    DMGCpu before = *cpu;
+    size_t start = state->cycles;
+    replay_block(state, block);
+    if (!same_registers(&before, cpu)) {
+        return;
+    }
+    uint64_t limit = state->sched.deadline;
+    for (uint8_t i = 0; i < block->count; i++) {
+        uint64_t change = next_change(state, read_address(cpu, &block->insns[i]));
+        if (change < limit) {
+            limit = change;
+        }
+    }
+    uint64_t period = state->cycles - start;
+    if (limit > state->cycles + period) {
+        state->cycles += (size_t) ((limit - 1 - state->cycles) / period * period);
+    }
+}
 
-        case 0x6F: // LD L, A
-            cpu->l = cpu->a;
-            break;
+/**
+ * Runs the block at pc, or a single instruction from memory that is never
+ * cached. Returns the block it ran, for the next step to follow its links.
+ */
+static DMG_INLINE DMGBlock *step_block(DMGState *state, DMGBlock *prev) {
+    DMGBlock *block = next_block(state, prev);
+    if (block && block->idle) {
+        replay_idle(state, block);
+    } else if (block) {
+        replay_block(state, block);
+    } else {
+        HANDLERS[read8_pc(state)](state);
+    }
+    return block;
+}
 
-        case 0x70: // LD (HL), B
-            write8(state, cpu->hl, cpu->b);
+static void run_block(DMGState *state) {
+    DMGBlock *block = NULL;
+    do {
+        if (!ready(state)) {
             break;
+        }
+        block = step_block(state, block);
+    } while (state->cycles < state->sched.deadline);
+}
+
+#ifdef DMG_JIT
+
+/**
+ * Runs a native block and then the same instructions through the reference
+ * interpreter on a copy of the state, keeping the interpreter's result if
+ * they disagree.
+ */
+static void run_native_lockstep(DMGState *state, DMGBlock *block) {
+    DMGJit *jit = &state->jit;
+    if (state->cart.save && state->cart.ram_enabled) {
+        // RAM in a save is outside the state, the shadow would write it too
+        ((DMGNativeBlock) block->native)(state);
+        return;
+    }
+    if (!jit->shadow) {
+        jit->shadow = calloc(1, sizeof(DMGState));
+        if (!jit->shadow) {
+            // Nothing to check against, run it unchecked
+            ((DMGNativeBlock) block->native)(state);
+            return;
+        }
+    }
+    DMGState *shadow = jit->shadow;
+    size_t size = offsetof(DMGState, blocks);
+    memcpy(shadow, state, size);
+    // Catching up its PPU must not hand the scratch copy to the frontend
+    shadow->ppu.vblank = NULL;
+    // Its pages still point at whatever banks it had last time, and its
+    // tiles at whatever VRAM held
+    dmg_mmu_unmap(shadow);
+    dmg_ppu_invalidate_all(shadow);
+
+    uint32_t executed = ((DMGNativeBlock) block->native)(state);
+    while (executed--) {
+        step_switch(shadow);
+    }
+    shadow->ppu.vblank = state->ppu.vblank;
+    jit->checked++;
+    if (memcmp(shadow, state, size) != 0) {
+        jit->mismatches++;
+        memcpy(state, shadow, size);
+        dmg_mmu_unmap(state);
+        dmg_ppu_invalidate_all(state);
+        // The interpreter may have written to code the native block did not
+        for (size_t i = 0; i < DMG_BLOCK_CACHE_SIZE; i++) {
+            state->blocks.blocks[i].key = 0;
+        }
+        state->blocks.epoch++;
+    }
+}
 
-        case 0x71: // LD (HL), C
-            write8(state, cpu->hl, cpu->c);
+/**
+ * JIT engine: the block engine, except that blocks which have been entered
+ * often enough are translated to native code and run that way whenever the
+ * whole block fits in the remaining budget.
+ */
+static void run_jit(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
+    do {
+        if (!ready(state)) {
             break;
+        }
+        DMGBlock *block = lookup_block(state, cpu->pc);
+        if (!block) {
+            HANDLERS[read8_pc(state)](state);
+            continue;
+        }
+        if (block->idle) {
+            replay_idle(state, block);
+            continue;
+        }
+        if (!block->native && block->hits < DMG_JIT_THRESHOLD && ++block->hits == DMG_JIT_THRESHOLD) {
+            dmg_jit_compile(state, block);
+        }
+        if (block->native && state->cycles + block->native_cycles <= state->sched.deadline) {
+            state->blocks.dirty = false;
+            if (state->jit.lockstep) {
+                run_native_lockstep(state, block);
+            } else {
+                ((DMGNativeBlock) block->native)(state);
+            }
+            continue;
+        }
+        replay_block(state, block);
+    } while (state->cycles < state->sched.deadline);
+}
+
+#endif
+
+#ifdef DMG_AOT
+
+/**
+ * AOT engine: blocks dmgaot found in the ROM libdmg was built with
+ * (DMG_AOT_ROM) are compiled C functions, anything else runs on the block
+ * engine. Bodies come from the opcode table with the operand as a constant.
+ */
+#define DMG_IMM8() ((uint8_t) operand)
+#define DMG_IMM16() (operand)
+#define DMG_DISPATCH_CB(opcode)
+
+#define DMG_OP(code, name, length, ...) \
+    static DMG_INLINE void aot_op_##code(DMGState *state, uint16_t operand) { DMGCpu *cpu = &state->cpu; (void) cpu; (void) operand; __VA_ARGS__ }
+#define DMG_CB_OP(code, name, length, ...) \
+    static DMG_INLINE void aot_cb_op_##code(DMGState *state, uint16_t operand) { DMGCpu *cpu = &state->cpu; (void) cpu; (void) operand; __VA_ARGS__ }
+#include <dmg/opcodes.h>
+
+#undef DMG_DISPATCH_CB
+#undef DMG_IMM8
+#undef DMG_IMM16
+
+typedef void (*DMGAotBlock)(DMGState *state);
+
+// Same accounting and exit conditions as replay_block
+#define DMG_AOT_OP(next, length, code, operand) \
+    cpu->pc = next; \
+    state->cycles += length * 4; \
+    aot_op_##code(state, operand); \
+    if (state->cycles >= deadline || state->blocks.dirty) { \
+        return; \
+    }
+#define DMG_AOT_CB_OP(next, code) \
+    cpu->pc = next; \
+    state->cycles += 8; \
+    aot_cb_op_##code(state, 0); \
+    if (state->cycles >= deadline || state->blocks.dirty) { \
+        return; \
+    }
 
-        case 0x72: // LD (HL), D
-            write8(state, cpu->hl, cpu->d);
-            break;
+#define DMG_AOT_ROM(hash) static const uint32_t AOT_HASH = hash;
+#define DMG_AOT_BLOCK(address, ...) \
+    static void aot_block_##address(DMGState *state) { \
+        DMGCpu *cpu = &state->cpu; \
+        uint64_t deadline = state->sched.deadline; \
+        __VA_ARGS__ \
+    }
+#include <dmg/aot.h>
+
+static const DMGAotBlock AOT_BLOCKS[0x8000] = {
+#define DMG_AOT_ROM(hash)
+#define DMG_AOT_BLOCK(address, ...) [address] = aot_block_##address,
+#include <dmg/aot.h>
+};
+
+#undef DMG_AOT_OP
+#undef DMG_AOT_CB_OP
+
+/**
+ * Checks that the cartridge is the one the blocks were generated from. The
+ * answer is kept until state->rom changes.
+ */
+static bool aot_matches(DMGState *state) {
+    DMGBlockCache *cache = &state->blocks;
+    if (cache->aot_rom != state->rom) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < 0x8000; i++) {
+            hash = (hash ^ state->rom[i]) * 16777619u;
+        }
+        cache->aot_rom = state->rom;
+        cache->aot_match = hash == AOT_HASH;
+    }
+    return cache->aot_match;
+}
 
-        case 0x73: // LD (HL), E
-            write8(state, cpu->hl, cpu->e);
+static void run_aot(DMGState *state) {
+    if (!aot_matches(state)) {
+        run_block(state);
+        return;
+    }
+    DMGCpu *cpu = &state->cpu;
+    do {
+        if (!ready(state)) {
             break;
+        }
+        uint16_t pc = cpu->pc;
+        DMGAotBlock block = NULL;
+        // dmgaot only sees the first two banks
+        bool precompiled = pc < 0x4000 ? state->cart.bank0 == 0 : state->cart.bankx == 1;
+        if (pc < 0x8000 && precompiled && (pc >= 0x0100 || state->mmu.io[DMG_IO_BIOS] != 0x00)) {
+            block = AOT_BLOCKS[pc];
+        }
+        if (block) {
+            state->blocks.dirty = false;
+            block(state);
+        } else {
+            step_block(state, NULL);
+        }
+    } while (state->cycles < state->sched.deadline);
+}
 
-        case 0x74: // LD (HL), H
-            write8(state, cpu->hl, cpu->h);
-            break;
+#endif
 
-        case 0x75: // LD (HL), L
-            write8(state, cpu->hl, cpu->l);
-            break;
+void dmg_cpu_free(DMGState *state) {
+#ifdef DMG_JIT
+    dmg_jit_free(state);
+    free(state->jit.shadow);
+    state->jit.shadow = NULL;
+#endif
+}
 
-        case 0x76: // HALT
-            halt(state);
-            break;
+bool dmg_cpu_engine_built(DMGCpuEngine engine) {
+    switch (engine) {
+        case DMG_CPU_ENGINE_THREADED:
+            return DMG_HAS_COMPUTED_GOTO;
 
-        case 0x77: // LD (HL), A
-            write8(state, cpu->hl, cpu->a);
-            break;
+        case DMG_CPU_ENGINE_JIT:
+#ifdef DMG_JIT
+            return true;
+#else
+            return false;
+#endif
 
-        case 0x78: // LD A, B
-            cpu->a = cpu->b;
-            break;
+        case DMG_CPU_ENGINE_AOT:
+#ifdef DMG_AOT
+            return true;
+#else
+            return false;
+#endif
 
-        case 0x79: // LD A, C
-            cpu->a = cpu->c;
-            break;
+        default:
+            return true;
+    }
+}
 
-        case 0x7A: // LD A, D
-            cpu->a = cpu->d;
-            break;
+size_t dmg_cpu_run(DMGState *state, size_t cycles) {
+    size_t start = state->cycles;
+    // Engines check the deadline rather than a local so that an event posted
+    // while they run can stop them early
+    state->sched.deadline = start + cycles;
 
-        case 0x7B: // LD A, E
-            cpu->a = cpu->e;
+    DMGCpuEngine engine = state->cpu.engine;
+    if (engine == DMG_CPU_ENGINE_DEFAULT) {
+        engine = DMG_CPU_ENGINE;
+    }
+    switch (engine) {
+        case DMG_CPU_ENGINE_SWITCH:
+            run_switch(state);
             break;
 
-        case 0x7C: // LD A, H
-            cpu->a = cpu->h;
+#if DMG_HAS_COMPUTED_GOTO
+        case DMG_CPU_ENGINE_THREADED:
+            run_threaded(state);
             break;
+#endif
 
-        case 0x7D: // LD A, L
-            cpu->a = cpu->l;
+#ifdef DMG_JIT
+        case DMG_CPU_ENGINE_JIT:
+            run_jit(state);
             break;
+#endif
 
-        case 0x7E: // LD A, (HL)
-            cpu->a = read8(state, cpu->hl);
+#ifdef DMG_AOT
+        case DMG_CPU_ENGINE_AOT:
+            run_aot(state);
             break;
+#endif
 
-        case 0x7F: // LD A, A
-            cpu->a = cpu->a;
+        // Engines left out of the build fall back to the block engine
+#ifndef DMG_JIT
+        case DMG_CPU_ENGINE_JIT:
+#endif
+#ifndef DMG_AOT
+        case DMG_CPU_ENGINE_AOT:
+#endif
+        case DMG_CPU_ENGINE_BLOCK:
+            run_block(state);
             break;
 
-        case 0x80: // ADD B
-            add_r(state, cpu->b);
+        default:
+            run_table(state);
             break;
-
-        case 0x81: // ADD C
-            add_r(state, cpu->c);
-            break;
-
-        case 0x82: // ADD D
-            add_r(state, cpu->d);
-            break;
-
-        case 0x83: // ADD E
-            add_r(state, cpu->e);
-            break;
-
-        case 0x84: // ADD H
-            add_r(state, cpu->h);
-            break;
-
-        case 0x85: // ADD L
-            add_r(state, cpu->l);
-            break;
-
-        case 0x86: // ADD (HL)
-            add_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0x87: // ADD A
-            add_r(state, cpu->a);
-            break;
-
-        case 0x88: // ADC B
-            adc_r(state, cpu->b);
-            break;
-
-        case 0x89: // ADC C
-            adc_r(state, cpu->c);
-            break;
-
-        case 0x8A: // ADC D
-            adc_r(state, cpu->c);
-            break;
-
-        case 0x8B: // ADC E
-            adc_r(state, cpu->e);
-            break;
-
-        case 0x8C: // ADC H
-            adc_r(state, cpu->h);
-            break;
-
-        case 0x8D: // ADC L
-            adc_r(state, cpu->l);
-            break;
-
-        case 0x8E: // ADC (HL)
-            adc_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0x8F: // ADC A
-            adc_r(state, cpu->a);
-            break;
-
-        case 0x90: // SUB B
-            sub_r(state, cpu->b);
-            break;
-
-        case 0x91: // SUB C
-            sub_r(state, cpu->c);
-            break;
-
-        case 0x92: // SUB D
-            sub_r(state, cpu->d);
-            break;
-
-        case 0x93: // SUB E
-            sub_r(state, cpu->e);
-            break;
-
-        case 0x94: // SUB H
-            sub_r(state, cpu->h);
-            break;
-
-        case 0x95: // SUB L
-            sub_r(state, cpu->l);
-            break;
-
-        case 0x96: // SUB (HL)
-            sub_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0x97: // SUB A
-            suba(state);
-            break;
-
-        case 0x98: // SBC B
-            sbc_r(state, cpu->b);
-            break;
-
-        case 0x99: // SBC C
-            sbc_r(state, cpu->c);
-            break;
-
-        case 0x9A: // SBC D
-            sbc_r(state, cpu->d);
-            break;
-
-        case 0x9B: // SBC E
-            sbc_r(state, cpu->e);
-            break;
-
-        case 0x9C: // SBC H
-            sbc_r(state, cpu->h);
-            break;
-
-        case 0x9D: // SBC L
-            sbc_r(state, cpu->l);
-            break;
-
-        case 0x9E: // SBC (HL)
-            sbc_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0x9F: // SBC A
-            sbc_r(state, cpu->a);
-            break;
-
-        case 0xA0: // AND B
-            and_r(state, cpu->b);
-            break;
-
-        case 0xA1: // AND C
-            and_r(state, cpu->c);
-            break;
-
-        case 0xA2: // AND D
-            and_r(state, cpu->d);
-            break;
-
-        case 0xA3: // AND E
-            and_r(state, cpu->e);
-            break;
-
-        case 0xA4: // AND H
-            and_r(state, cpu->h);
-            break;
-
-        case 0xA5: // AND L
-            and_r(state, cpu->l);
-            break;
-
-        case 0xA6: // AND (HL)
-            and_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0xA7: // AND A
-            and_r(state, cpu->a);
-            break;
-
-        case 0xA8: // XOR B
-            xor_r(state, cpu->b);
-            break;
-
-        case 0xA9: // XOR C
-            xor_r(state, cpu->c);
-            break;
-
-        case 0xAA: // XOR D
-            xor_r(state, cpu->d);
-            break;
-
-        case 0xAB: // XOR E
-            xor_r(state, cpu->e);
-            break;
-
-        case 0xAC: // XOR H
-            xor_r(state, cpu->h);
-            break;
-
-        case 0xAD: // XOR L
-            xor_r(state, cpu->l);
-            break;
-
-        case 0xAE: // XOR (HL)
-            xor_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0xAF: // XOR A
-            xor_r(state, cpu->a);
-            break;
-
-        case 0xB0: // OR B
-            or_r(state, cpu->b);
-            break;
-
-        case 0xB1: // OR C
-            or_r(state, cpu->c);
-            break;
-
-        case 0xB2: // OR D
-            or_r(state, cpu->d);
-            break;
-
-        case 0xB3: // OR E
-            or_r(state, cpu->e);
-            break;
-
-        case 0xB4: // OR H
-            or_r(state, cpu->h);
-            break;
-
-        case 0xB5: // OR L
-            or_r(state, cpu->l);
-            break;
-
-        case 0xB6: // OR (HL)
-            or_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0xB7: // OR A
-            or_r(state, cpu->a);
-            break;
-
-        case 0xB8: // CP B
-            cp_r(state, cpu->b);
-            break;
-
-        case 0xB9: // CP C
-            cp_r(state, cpu->c);
-            break;
-
-        case 0xBA: // CP D
-            cp_r(state, cpu->d);
-            break;
-
-        case 0xBB: // CP E
-            cp_r(state, cpu->e);
-            break;
-
-        case 0xBC: // CP H
-            cp_r(state, cpu->h);
-            break;
-
-        case 0xBD: // CP L
-            cp_r(state, cpu->l);
-            break;
-
-        case 0xBE: // CP (HL)
-            cp_r(state, read8(state, cpu->hl));
-            break;
-
-        case 0xBF: // CP A
-            cp_r(state, cpu->a);
-            break;
-
-        case 0xC0: // RET NZ
-            ret_nz(state);
-            break;
-
-        case 0xC1: // POP BC
-            cpu->bc = pop16(state);
-            break;
-
-        case 0xC2: // JP NZ, NN
-            jp_nz(state);
-            break;
-
-        case 0xC3: // JP NN
-            jp_nn(state);
-            break;
-
-        case 0xC4: // CALL NZ, NN
-            call_nz(state);
-            break;
-
-        case 0xC5: // PUSH BC
-            push16(state, cpu->bc);
-            break;
-
-        case 0xC6: // ADD N
-            add_r(state, read8_pc(state));
-            break;
-
-        case 0xC7: // RST $00
-            rst(state, 0x00);
-            break;
-
-        case 0xC8: // RET Z
-            ret_z(state);
-            break;
-
-        case 0xC9: // RET
-            ret(state);
-            break;
-
-        case 0xCA: // JP Z, NN
-            jp_z(state);
-            break;
-
-        case 0xCB: // CB-PREFIX
-            switch (read8_pc(state)) {
-
-                case 0x00: // RLC B
-                    rlc_r(state, &cpu->b);
-                    break;
-
-                case 0x01: // RLC C
-                    rlc_r(state, &cpu->c);
-                    break;
-
-                case 0x02: // RLC D
-                    rlc_r(state, &cpu->d);
-                    break;
-
-                case 0x03: // RLC E
-                    rlc_r(state, &cpu->e);
-                    break;
-
-                case 0x04: // RLC H
-                    rlc_r(state, &cpu->h);
-                    break;
-
-                case 0x05: // RLC L
-                    rlc_r(state, &cpu->l);
-                    break;
-
-                case 0x06: // RLC (HL)
-                    rlc_mem_hl(state);
-                    break;
-
-                case 0x07: // RLC A
-                    rlc_r(state, &cpu->a);
-                    break;
-
-                case 0x08: // RRC B
-                    rrc_r(state, &cpu->b);
-                    break;
-
-                case 0x09: // RRC C
-                    rrc_r(state, &cpu->c);
-                    break;
-
-                case 0x0A: // RRC D
-                    rrc_r(state, &cpu->d);
-                    break;
-
-                case 0x0B: // RRC E
-                    rrc_r(state, &cpu->e);
-                    break;
-
-                case 0x0C: // RRC H
-                    rrc_r(state, &cpu->h);
-                    break;
-
-                case 0x0D: // RRC L
-                    rrc_r(state, &cpu->l);
-                    break;
-
-                case 0x0E: // RRC (HL)
-                    rrc_mem_hl(state);
-                    break;
-
-                case 0x0F: // RRC A
-                    rrc_r(state, &cpu->a);
-                    break;
-
-                case 0x10: // RL B
-                    rl_r(state, &cpu->b);
-                    break;
-
-                case 0x11: // RL C
-                    rl_r(state, &cpu->c);
-                    break;
-
-                case 0x12: // RL D
-                    rl_r(state, &cpu->d);
-                    break;
-
-                case 0x13: // RL E
-                    rl_r(state, &cpu->e);
-                    break;
-
-                case 0x14: // RL H
-                    rl_r(state, &cpu->h);
-                    break;
-
-                case 0x15: // RL L
-                    rl_r(state, &cpu->l);
-                    break;
-
-                case 0x16: // RL (HL)
-                    rl_mem_hl(state);
-                    break;
-
-                case 0x17: // RL A
-                    rl_r(state, &cpu->a);
-                    break;
-
-                case 0x18: // RR B
-                    rr_r(state, &cpu->b);
-                    break;
-
-                case 0x19: // RR C
-                    rr_r(state, &cpu->c);
-                    break;
-
-                case 0x1A: // RR D
-                    rr_r(state, &cpu->d);
-                    break;
-
-                case 0x1B: // RR E
-                    rr_r(state, &cpu->e);
-                    break;
-
-                case 0x1C: // RR H
-                    rr_r(state, &cpu->h);
-                    break;
-
-                case 0x1D: // RR L
-                    rr_r(state, &cpu->l);
-                    break;
-
-                case 0x1E: // RR (HL)
-                    rr_mem_hl(state);
-                    break;
-
-                case 0x1F: // RR A
-                    rr_r(state, &cpu->a);
-                    break;
-
-                case 0x20: // SLA B
-                    sla_r(state, &cpu->b);
-                    break;
-
-                case 0x21: // SLA C
-                    sla_r(state, &cpu->c);
-                    break;
-
-                case 0x22: // SLA D
-                    sla_r(state, &cpu->d);
-                    break;
-
-                case 0x23: // SLA E
-                    sla_r(state, &cpu->e);
-                    break;
-
-                case 0x24: // SLA H
-                    sla_r(state, &cpu->h);
-                    break;
-
-                case 0x25: // SLA L
-                    sla_r(state, &cpu->l);
-                    break;
-
-                case 0x26: // SLA (HL)
-                    sla_mem_hl(state);
-                    break;
-
-                case 0x27: // SLA A
-                    sla_r(state, &cpu->a);
-                    break;
-
-                case 0x28: // SRA B
-                    sra_r(state, &cpu->b);
-                    break;
-
-                case 0x29: // SRA C
-                    sra_r(state, &cpu->c);
-                    break;
-
-                case 0x2A: // SRA D
-                    sra_r(state, &cpu->d);
-                    break;
-
-                case 0x2B: // SRA E
-                    sra_r(state, &cpu->e);
-                    break;
-
-                case 0x2C: // SRA H
-                    sra_r(state, &cpu->h);
-                    break;
-
-                case 0x2D: // SRA L
-                    sra_r(state, &cpu->l);
-                    break;
-
-                case 0x2E: // SRA (HL)
-                    sra_mem_hl(state);
-                    break;
-
-                case 0x2F: // SRA A
-                    sra_r(state, &cpu->a);
-                    break;
-
-                case 0x30: // SWAP B
-                    swap_r(state, &cpu->b);
-                    break;
-
-                case 0x31: // SWAP C
-                    swap_r(state, &cpu->c);
-                    break;
-
-                case 0x32: // SWAP D
-                    swap_r(state, &cpu->d);
-                    break;
-
-                case 0x33: // SWAP E
-                    swap_r(state, &cpu->e);
-                    break;
-
-                case 0x34: // SWAP H
-                    swap_r(state, &cpu->h);
-                    break;
-
-                case 0x35: // SWAP L
-                    swap_r(state, &cpu->l);
-                    break;
-
-                case 0x36: // SWAP (HL)
-                    swap_mem_hl(state);
-                    break;
-
-                case 0x37: // SWAP A
-                    swap_r(state, &cpu->a);
-                    break;
-
-                case 0x38: // SRL B
-                    srl_r(state, &cpu->b);
-                    break;
-
-                case 0x39: // SRL C
-                    srl_r(state, &cpu->c);
-                    break;
-
-                case 0x3A: // SRL D
-                    srl_r(state, &cpu->d);
-                    break;
-
-                case 0x3B: // SRL E
-                    srl_r(state, &cpu->e);
-                    break;
-
-                case 0x3C: // SRL H
-                    srl_r(state, &cpu->h);
-                    break;
-
-                case 0x3D: // SRL L
-                    srl_r(state, &cpu->l);
-                    break;
-
-                case 0x3E: // SRL (HL)
-                    srl_mem_hl(state);
-                    break;
-
-                case 0x3F: // SRL A
-                    srl_r(state, &cpu->a);
-                    break;
-
-                case 0x40: // BIT 0, B
-                    bit_r(state, cpu->b, 0);
-                    break;
-
-                case 0x41: // BIT 0, C
-                    bit_r(state, cpu->c, 0);
-                    break;
-
-                case 0x42: // BIT 0, D
-                    bit_r(state, cpu->d, 0);
-                    break;
-
-                case 0x43: // BIT 0, E
-                    bit_r(state, cpu->e, 0);
-                    break;
-
-                case 0x44: // BIT 0, H
-                    bit_r(state, cpu->h, 0);
-                    break;
-
-                case 0x45: // BIT 0, L
-                    bit_r(state, cpu->l, 0);
-                    break;
-
-                case 0x46: // BIT 0, (HL)
-                    bit_r(state, read8(state, cpu->hl), 0);
-                    break;
-
-                case 0x47: // BIT 0, A
-                    bit_r(state, cpu->a, 0);
-                    break;
-
-                case 0x48: // BIT 1, B
-                    bit_r(state, cpu->b, 1);
-                    break;
-
-                case 0x49: // BIT 1, C
-                    bit_r(state, cpu->c, 1);
-                    break;
-
-                case 0x4A: // BIT 1, D
-                    bit_r(state, cpu->d, 1);
-                    break;
-
-                case 0x4B: // BIT 1, E
-                    bit_r(state, cpu->e, 1);
-                    break;
-
-                case 0x4C: // BIT 1, H
-                    bit_r(state, cpu->h, 1);
-                    break;
-
-                case 0x4D: // BIT 1, L
-                    bit_r(state, cpu->l, 1);
-                    break;
-
-                case 0x4E: // BIT 1, (HL)
-                    bit_r(state, read8(state, cpu->hl), 1);
-                    break;
-
-                case 0x4F: // BIT 1, A
-                    bit_r(state, cpu->a, 1);
-                    break;
-
-                case 0x50: // BIT 2, B
-                    bit_r(state, cpu->b, 2);
-                    break;
-
-                case 0x51: // BIT 2, C
-                    bit_r(state, cpu->c, 2);
-                    break;
-
-                case 0x52: // BIT 2, D
-                    bit_r(state, cpu->d, 2);
-                    break;
-
-                case 0x53: // BIT 2, E
-                    bit_r(state, cpu->e, 2);
-                    break;
-
-                case 0x54: // BIT 2, H
-                    bit_r(state, cpu->h, 2);
-                    break;
-
-                case 0x55: // BIT 2, L
-                    bit_r(state, cpu->l, 2);
-                    break;
-
-                case 0x56: // BIT 2, (HL)
-                    bit_r(state, read8(state, cpu->hl), 2);
-                    break;
-
-                case 0x57: // BIT 2, A
-                    bit_r(state, cpu->a, 2);
-                    break;
-
-                case 0x58: // BIT 3, B
-                    bit_r(state, cpu->b, 3);
-                    break;
-
-                case 0x59: // BIT 3, C
-                    bit_r(state, cpu->c, 3);
-                    break;
-
-                case 0x5A: // BIT 3, D
-                    bit_r(state, cpu->d, 3);
-                    break;
-
-                case 0x5B: // BIT 3, E
-                    bit_r(state, cpu->e, 3);
-                    break;
-
-                case 0x5C: // BIT 3, H
-                    bit_r(state, cpu->h, 3);
-                    break;
-
-                case 0x5D: // BIT 3, L
-                    bit_r(state, cpu->l, 3);
-                    break;
-
-                case 0x5E: // BIT 3, (HL)
-                    bit_r(state, read8(state, cpu->hl), 3);
-                    break;
-
-                case 0x5F: // BIT 3, A
-                    bit_r(state, cpu->a, 3);
-                    break;
-
-                case 0x60: // BIT 4, B
-                    bit_r(state, cpu->b, 4);
-                    break;
-
-                case 0x61: // BIT 4, C
-                    bit_r(state, cpu->c, 4);
-                    break;
-
-                case 0x62: // BIT 4, D
-                    bit_r(state, cpu->d, 4);
-                    break;
-
-                case 0x63: // BIT 4, E
-                    bit_r(state, cpu->e, 4);
-                    break;
-
-                case 0x64: // BIT 4, H
-                    bit_r(state, cpu->h, 4);
-                    break;
-
-                case 0x65: // BIT 4, L
-                    bit_r(state, cpu->l, 4);
-                    break;
-
-                case 0x66: // BIT 4, (HL)
-                    bit_r(state, read8(state, cpu->hl), 4);
-                    break;
-
-                case 0x67: // BIT 4, A
-                    bit_r(state, cpu->a, 4);
-                    break;
-
-                case 0x68: // BIT 5, B
-                    bit_r(state, cpu->b, 5);
-                    break;
-
-                case 0x69: // BIT 5, C
-                    bit_r(state, cpu->c, 5);
-                    break;
-
-                case 0x6A: // BIT 5, D
-                    bit_r(state, cpu->d, 5);
-                    break;
-
-                case 0x6B: // BIT 5, E
-                    bit_r(state, cpu->e, 5);
-                    break;
-
-                case 0x6C: // BIT 5, H
-                    bit_r(state, cpu->h, 5);
-                    break;
-
-                case 0x6D: // BIT 5, L
-                    bit_r(state, cpu->l, 5);
-                    break;
-
-                case 0x6E: // BIT 5, (HL)
-                    bit_r(state, read8(state, cpu->hl), 5);
-                    break;
-
-                case 0x6F: // BIT 5, A
-                    bit_r(state, cpu->a, 5);
-                    break;
-
-                case 0x70: // BIT 6, B
-                    bit_r(state, cpu->b, 6);
-                    break;
-
-                case 0x71: // BIT 6, C
-                    bit_r(state, cpu->c, 6);
-                    break;
-
-                case 0x72: // BIT 6, D
-                    bit_r(state, cpu->d, 6);
-                    break;
-
-                case 0x73: // BIT 6, E
-                    bit_r(state, cpu->e, 6);
-                    break;
-
-                case 0x74: // BIT 6, H
-                    bit_r(state, cpu->h, 6);
-                    break;
-
-                case 0x75: // BIT 6, L
-                    bit_r(state, cpu->l, 6);
-                    break;
-
-                case 0x76: // BIT 6, (HL)
-                    bit_r(state, read8(state, cpu->hl), 6);
-                    break;
-
-                case 0x77: // BIT 6, A
-                    bit_r(state, cpu->a, 6);
-                    break;
-
-                case 0x78: // BIT 7, B
-                    bit_r(state, cpu->b, 7);
-                    break;
-
-                case 0x79: // BIT 7, C
-                    bit_r(state, cpu->c, 7);
-                    break;
-
-                case 0x7A: // BIT 7, D
-                    bit_r(state, cpu->d, 7);
-                    break;
-
-                case 0x7B: // BIT 7, E
-                    bit_r(state, cpu->e, 7);
-                    break;
-
-                case 0x7C: // BIT 7, H
-                    bit_r(state, cpu->h, 7);
-                    break;
-
-                case 0x7D: // BIT 7, L
-                    bit_r(state, cpu->l, 7);
-                    break;
-
-                case 0x7E: // BIT 7, (HL)
-                    bit_r(state, read8(state, cpu->hl), 7);
-                    break;
-
-                case 0x7F: // BIT 7, A
-                    bit_r(state, cpu->a, 7);
-                    break;
-
-                case 0x80: // RES 0, B
-                    set_bit(&cpu->b, 0, false);
-                    break;
-
-                case 0x81: // RES 0, C
-                    set_bit(&cpu->c, 0, false);
-                    break;
-
-                case 0x82: // RES 0, D
-                    set_bit(&cpu->d, 0, false);
-                    break;
-
-                case 0x83: // RES 0, E
-                    set_bit(&cpu->e, 0, false);
-                    break;
-
-                case 0x84: // RES 0, H
-                    set_bit(&cpu->h, 0, false);
-                    break;
-
-                case 0x85: // RES 0, L
-                    set_bit(&cpu->l, 0, false);
-                    break;
-
-                case 0x86: // RES 0, (HL)
-                    set_bit_mem_hl(state, 0, false);
-                    break;
-
-                case 0x87: // RES 0, A
-                    set_bit(&cpu->a, 0, false);
-                    break;
-
-                case 0x88: // RES 1, B
-                    set_bit(&cpu->b, 1, false);
-                    break;
-
-                case 0x89: // RES 1, C
-                    set_bit(&cpu->c, 1, false);
-                    break;
-
-                case 0x8A: // RES 1, D
-                    set_bit(&cpu->d, 1, false);
-                    break;
-
-                case 0x8B: // RES 1, E
-                    set_bit(&cpu->e, 1, false);
-                    break;
-
-                case 0x8C: // RES 1, H
-                    set_bit(&cpu->h, 1, false);
-                    break;
-
-                case 0x8D: // RES 1, L
-                    set_bit(&cpu->l, 1, false);
-                    break;
-
-                case 0x8E: // RES 1, (HL)
-                    set_bit_mem_hl(state, 1, false);
-                    break;
-
-                case 0x8F: // RES 1, A
-                    set_bit(&cpu->a, 1, false);
-                    break;
-
-                case 0x90: // RES 2, B
-                    set_bit(&cpu->b, 2, false);
-                    break;
-
-                case 0x91: // RES 2, C
-                    set_bit(&cpu->c, 2, false);
-                    break;
-
-                case 0x92: // RES 2, D
-                    set_bit(&cpu->d, 2, false);
-                    break;
-
-                case 0x93: // RES 2, E
-                    set_bit(&cpu->e, 2, false);
-                    break;
-
-                case 0x94: // RES 2, H
-                    set_bit(&cpu->h, 2, false);
-                    break;
-
-                case 0x95: // RES 2, L
-                    set_bit(&cpu->l, 2, false);
-                    break;
-
-                case 0x96: // RES 2, (HL)
-                    set_bit_mem_hl(state, 2, false);
-                    break;
-
-                case 0x97: // RES 2, A
-                    set_bit(&cpu->a, 2, false);
-                    break;
-
-                case 0x98: // RES 3, B
-                    set_bit(&cpu->b, 3, false);
-                    break;
-
-                case 0x99: // RES 3, C
-                    set_bit(&cpu->c, 3, false);
-                    break;
-
-                case 0x9A: // RES 3, D
-                    set_bit(&cpu->d, 3, false);
-                    break;
-
-                case 0x9B: // RES 3, E
-                    set_bit(&cpu->e, 3, false);
-                    break;
-
-                case 0x9C: // RES 3, H
-                    set_bit(&cpu->h, 3, false);
-                    break;
-
-                case 0x9D: // RES 3, L
-                    set_bit(&cpu->l, 3, false);
-                    break;
-
-                case 0x9E: // RES 3, (HL)
-                    set_bit_mem_hl(state, 3, false);
-                    break;
-
-                case 0x9F: // RES 3, A
-                    set_bit(&cpu->a, 3, false);
-                    break;
-
-                case 0xA0: // RES 4, B
-                    set_bit(&cpu->b, 4, false);
-                    break;
-
-                case 0xA1: // RES 4, C
-                    set_bit(&cpu->c, 4, false);
-                    break;
-
-                case 0xA2: // RES 4, D
-                    set_bit(&cpu->d, 4, false);
-                    break;
-
-                case 0xA3: // RES 4, E
-                    set_bit(&cpu->e, 4, false);
-                    break;
-
-                case 0xA4: // RES 4, H
-                    set_bit(&cpu->h, 4, false);
-                    break;
-
-                case 0xA5: // RES 4, L
-                    set_bit(&cpu->l, 4, false);
-                    break;
-
-                case 0xA6: // RES 4, (HL)
-                    set_bit_mem_hl(state, 4, false);
-                    break;
-
-                case 0xA7: // RES 4, A
-                    set_bit(&cpu->a, 4, false);
-                    break;
-
-                case 0xA8: // RES 5, B
-                    set_bit(&cpu->b, 5, false);
-                    break;
-
-                case 0xA9: // RES 5, C
-                    set_bit(&cpu->c, 5, false);
-                    break;
-
-                case 0xAA: // RES 5, D
-                    set_bit(&cpu->d, 5, false);
-                    break;
-
-                case 0xAB: // RES 5, E
-                    set_bit(&cpu->e, 5, false);
-                    break;
-
-                case 0xAC: // RES 5, H
-                    set_bit(&cpu->h, 5, false);
-                    break;
-
-                case 0xAD: // RES 5, L
-                    set_bit(&cpu->l, 5, false);
-                    break;
-
-                case 0xAE: // RES 5, (HL)
-                    set_bit_mem_hl(state, 5, false);
-                    break;
-
-                case 0xAF: // RES 5, A
-                    set_bit(&cpu->a, 5, false);
-                    break;
-
-                case 0xB0: // RES 6, B
-                    set_bit(&cpu->b, 6, false);
-                    break;
-
-                case 0xB1: // RES 6, C
-                    set_bit(&cpu->c, 6, false);
-                    break;
-
-                case 0xB2: // RES 6, D
-                    set_bit(&cpu->d, 6, false);
-                    break;
-
-                case 0xB3: // RES 6, E
-                    set_bit(&cpu->e, 6, false);
-                    break;
-
-                case 0xB4: // RES 6, H
-                    set_bit(&cpu->h, 6, false);
-                    break;
-
-                case 0xB5: // RES 6, L
-                    set_bit(&cpu->l, 6, false);
-                    break;
-
-                case 0xB6: // RES 6, (HL)
-                    set_bit_mem_hl(state, 6, false);
-                    break;
-
-                case 0xB7: // RES 6, A
-                    set_bit(&cpu->a, 6, false);
-                    break;
-
-                case 0xB8: // RES 7, B
-                    set_bit(&cpu->b, 7, false);
-                    break;
-
-                case 0xB9: // RES 7, C
-                    set_bit(&cpu->c, 7, false);
-                    break;
-
-                case 0xBA: // RES 7, D
-                    set_bit(&cpu->d, 7, false);
-                    break;
-
-                case 0xBB: // RES 7, E
-                    set_bit(&cpu->e, 7, false);
-                    break;
-
-                case 0xBC: // RES 7, H
-                    set_bit(&cpu->h, 7, false);
-                    break;
-
-                case 0xBD: // RES 7, L
-                    set_bit(&cpu->l, 7, false);
-                    break;
-
-                case 0xBE: // RES 7, (HL)
-                    set_bit_mem_hl(state, 7, false);
-                    break;
-
-                case 0xBF: // RES 7, A
-                    set_bit(&cpu->a, 7, false);
-                    break;
-
-                case 0xC0: // SET 0, B
-                    set_bit(&cpu->b, 0, true);
-                    break;
-
-                case 0xC1: // SET 0, C
-                    set_bit(&cpu->c, 0, true);
-                    break;
-
-                case 0xC2: // SET 0, D
-                    set_bit(&cpu->d, 0, true);
-                    break;
-
-                case 0xC3: // SET 0, E
-                    set_bit(&cpu->e, 0, true);
-                    break;
-
-                case 0xC4: // SET 0, H
-                    set_bit(&cpu->h, 0, true);
-                    break;
-
-                case 0xC5: // SET 0, L
-                    set_bit(&cpu->l, 0, true);
-                    break;
-
-                case 0xC6: // SET 0, (HL)
-                    set_bit_mem_hl(state, 0, true);
-                    break;
-
-                case 0xC7: // SET 0, A
-                    set_bit(&cpu->a, 0, true);
-                    break;
-
-                case 0xC8: // SET 1, B
-                    set_bit(&cpu->b, 1, true);
-                    break;
-
-                case 0xC9: // SET 1, C
-                    set_bit(&cpu->c, 1, true);
-                    break;
-
-                case 0xCA: // SET 1, D
-                    set_bit(&cpu->d, 1, true);
-                    break;
-
-                case 0xCB: // SET 1, E
-                    set_bit(&cpu->e, 1, true);
-                    break;
-
-                case 0xCC: // SET 1, H
-                    set_bit(&cpu->h, 1, true);
-                    break;
-
-                case 0xCD: // SET 1, L
-                    set_bit(&cpu->l, 1, true);
-                    break;
-
-                case 0xCE: // SET 1, (HL)
-                    set_bit_mem_hl(state, 1, true);
-                    break;
-
-                case 0xCF: // SET 1, A
-                    set_bit(&cpu->a, 1, true);
-                    break;
-
-                case 0xD0: // SET 2, B
-                    set_bit(&cpu->b, 2, true);
-                    break;
-
-                case 0xD1: // SET 2, C
-                    set_bit(&cpu->c, 2, true);
-                    break;
-
-                case 0xD2: // SET 2, D
-                    set_bit(&cpu->d, 2, true);
-                    break;
-
-                case 0xD3: // SET 2, E
-                    set_bit(&cpu->e, 2, true);
-                    break;
-
-                case 0xD4: // SET 2, H
-                    set_bit(&cpu->h, 2, true);
-                    break;
-
-                case 0xD5: // SET 2, L
-                    set_bit(&cpu->l, 2, true);
-                    break;
-
-                case 0xD6: // SET 2, (HL)
-                    set_bit_mem_hl(state, 2, true);
-                    break;
-
-                case 0xD7: // SET 2, A
-                    set_bit(&cpu->a, 2, true);
-                    break;
-
-                case 0xD8: // SET 3, B
-                    set_bit(&cpu->b, 3, true);
-                    break;
-
-                case 0xD9: // SET 3, C
-                    set_bit(&cpu->c, 3, true);
-                    break;
-
-                case 0xDA: // SET 3, D
-                    set_bit(&cpu->d, 3, true);
-                    break;
-
-                case 0xDB: // SET 3, E
-                    set_bit(&cpu->e, 3, true);
-                    break;
-
-                case 0xDC: // SET 3, H
-                    set_bit(&cpu->h, 3, true);
-                    break;
-
-                case 0xDD: // SET 3, L
-                    set_bit(&cpu->l, 3, true);
-                    break;
-
-                case 0xDE: // SET 3, (HL)
-                    set_bit_mem_hl(state, 3, true);
-                    break;
-
-                case 0xDF: // SET 3, A
-                    set_bit(&cpu->a, 3, true);
-                    break;
-
-                case 0xE0: // SET 4, B
-                    set_bit(&cpu->b, 4, true);
-                    break;
-
-                case 0xE1: // SET 4, C
-                    set_bit(&cpu->c, 4, true);
-                    break;
-
-                case 0xE2: // SET 4, D
-                    set_bit(&cpu->d, 4, true);
-                    break;
-
-                case 0xE3: // SET 4, E
-                    set_bit(&cpu->e, 4, true);
-                    break;
-
-                case 0xE4: // SET 4, H
-                    set_bit(&cpu->h, 4, true);
-                    break;
-
-                case 0xE5: // SET 4, L
-                    set_bit(&cpu->l, 4, true);
-                    break;
-
-                case 0xE6: // SET 4, (HL)
-                    set_bit_mem_hl(state, 4, true);
-                    break;
-
-                case 0xE7: // SET 4, A
-                    set_bit(&cpu->a, 4, true);
-                    break;
-
-                case 0xE8: // SET 5, B
-                    set_bit(&cpu->b, 5, true);
-                    break;
-
-                case 0xE9: // SET 5, C
-                    set_bit(&cpu->c, 5, true);
-                    break;
-
-                case 0xEA: // SET 5, D
-                    set_bit(&cpu->d, 5, true);
-                    break;
-
-                case 0xEB: // SET 5, E
-                    set_bit(&cpu->e, 5, true);
-                    break;
-
-                case 0xEC: // SET 5, H
-                    set_bit(&cpu->h, 5, true);
-                    break;
-
-                case 0xED: // SET 5, L
-                    set_bit(&cpu->l, 5, true);
-                    break;
-
-                case 0xEE: // SET 5, (HL)
-                    set_bit_mem_hl(state, 5, true);
-                    break;
-
-                case 0xEF: // SET 5, A
-                    set_bit(&cpu->a, 5, true);
-                    break;
-
-                case 0xF0: // SET 6, B
-                    set_bit(&cpu->b, 6, true);
-                    break;
-
-                case 0xF1: // SET 6, C
-                    set_bit(&cpu->c, 6, true);
-                    break;
-
-                case 0xF2: // SET 6, D
-                    set_bit(&cpu->d, 6, true);
-                    break;
-
-                case 0xF3: // SET 6, E
-                    set_bit(&cpu->e, 6, true);
-                    break;
-
-                case 0xF4: // SET 6, H
-                    set_bit(&cpu->h, 6, true);
-                    break;
-
-                case 0xF5: // SET 6, L
-                    set_bit(&cpu->l, 6, true);
-                    break;
-
-                case 0xF6: // SET 6, (HL)
-                    set_bit_mem_hl(state, 6, true);
-                    break;
-
-                case 0xF7: // SET 6, A
-                    set_bit(&cpu->a, 6, true);
-                    break;
-
-                case 0xF8: // SET 7, B
-                    set_bit(&cpu->b, 7, true);
-                    break;
-
-                case 0xF9: // SET 7, C
-                    set_bit(&cpu->c, 7, true);
-                    break;
-
-                case 0xFA: // SET 7, D
-                    set_bit(&cpu->d, 7, true);
-                    break;
-
-                case 0xFB: // SET 7, E
-                    set_bit(&cpu->e, 7, true);
-                    break;
-
-                case 0xFC: // SET 7, H
-                    set_bit(&cpu->h, 7, true);
-                    break;
-
-                case 0xFD: // SET 7, L
-                    set_bit(&cpu->l, 7, true);
-                    break;
-
-                case 0xFE: // SET 7, (HL)
-                    set_bit_mem_hl(state, 7, true);
-                    break;
-
-                case 0xFF: // SET 7, A
-                    set_bit(&cpu->a, 7, true);
-                    break;
-
-                default:
-                    assert(false);
-            }
-            break;
-
-        case 0xCC: // CALL Z, NN
-            call_z(state);
-            break;
-
-        case 0xCD: // CALL NN
-            call_nn(state);
-            break;
-
-        case 0xCE: // ADC N
-            adc_r(state, read8_pc(state));
-            break;
-
-        case 0xCF: // RST $08
-            rst(state, 0x08);
-            break;
-
-        case 0xD0: // RET NC
-            ret_nc(state);
-            break;
-
-        case 0xD1: // POP DE
-            cpu->de = pop16(state);
-            break;
-
-        case 0xD2: // JP NC, NN
-            jp_nc(state);
-            break;
-
-        case 0xD3: // INVALID
-            break;
-
-        case 0xD4: // CALL NC, NN
-            call_nc(state);
-            break;
-
-        case 0xD5: // PUSH DE
-            push16(state, cpu->de);
-            break;
-
-        case 0xD6: // SUB N
-            sub_r(state, read8_pc(state));
-            break;
-
-        case 0xD7: // RST $10
-            rst(state, 0x10);
-            break;
-
-        case 0xD8: // RET C
-            ret_c(state);
-            break;
-
-        case 0xD9: // RETI
-            reti(state);
-            break;
-
-        case 0xDA: // JP C, NN
-            jp_c(state);
-            break;
-
-        case 0xDB: // INVALID
-            break;
-
-        case 0xDC: // CALL C, NN
-            call_c(state);
-            break;
-
-        case 0xDD: // INVALID
-            break;
-
-        case 0xDE: // SBC N
-            sbc_r(state, read8_pc(state));
-            break;
-
-        case 0xDF: // RST $18
-            rst(state, 0x18);
-            break;
-
-        case 0xE0: // LDH (N), A
-            write8(state, (uint16_t) (0xFF00 + read8_pc(state)), cpu->a);
-            break;
-
-        case 0xE1: // POP HL
-            cpu->hl = pop16(state);
-            break;
-
-        case 0xE2: // LDH (C), A
-            write8(state, (uint16_t) (0xFF00 + cpu->c), cpu->a);
-            break;
-
-        case 0xE3: // INVALID
-            break;
-
-        case 0xE4: // INVALID
-            break;
-
-        case 0xE5: // PUSH HL
-            push16(state, cpu->hl);
-            break;
-
-        case 0xE6: // AND N
-            and_r(state, read8_pc(state));
-            break;
-
-        case 0xE7: // RST $20
-            rst(state, 0x20);
-            break;
-
-        case 0xE8: // ADD SP, N
-            add_sp_n(state);
-            break;
-
-        case 0xE9: // JP HL
-            cpu->pc = cpu->hl;
-            break;
-
-        case 0xEA: // LD (NN), A
-            write8(state, read16_pc(state), cpu->a);
-            break;
-
-        case 0xEB: // INVALID
-            break;
-
-        case 0xEC: // INVALID
-            break;
-
-        case 0xED: // INVALID
-            break;
-
-        case 0xEE: // XOR N
-            xor_r(state, read8_pc(state));
-            break;
-
-        case 0xEF: // RST $28
-            rst(state, 0x28);
-            break;
-
-        case 0xF0: // LDH A, (N)
-            cpu->a = read8(state, (uint16_t) (0xFF00 + read8_pc(state)));
-            break;
-
-        case 0xF1: // POP AF
-            cpu->af = (uint16_t) (pop16(state) & 0xFFF0);
-            break;
-
-        case 0xF2: // LDH A, (C)
-            cpu->a = read8(state, (uint16_t) (0xFF00 + cpu->c));
-            break;
-
-        case 0xF3: // DI
-            cpu->ime = false;
-            break;
-
-        case 0xF4: // INVALID
-            break;
-
-        case 0xF5: // PUSH AF
-            push16(state, (uint16_t) (cpu->af & 0xFFF0));
-            break;
-
-        case 0xF6: // OR N
-            or_r(state, read8_pc(state));
-            break;
-
-        case 0xF7: // RST $30
-            rst(state, 0x30);
-            break;
-
-        case 0xF8: // LDHL SP, N
-            ldhl_sp_n(state);
-            break;
-
-        case 0xF9: // LD SP, HL
-            ld_sp_hl(state);
-            break;
-
-        case 0xFA: // LD A, (NN)
-            cpu->a = read8(state, read8_pc(state));
-            break;
-
-        case 0xFB: // EI
-            cpu->ime = true;
-            break;
-
-        case 0xFC: // INVALID
-            break;
-
-        case 0xFD: // INVALID
-            break;
-
-        case 0xFE: // CP N
-            cp_r(state, read8_pc(state));
-            break;
-
-        case 0xFF: // RST $38
-            rst(state, 0x38);
-            break;
-
-        default:
-            assert(false);
     }
+    return state->cycles - start;
 }
@@ -1 +1,66 @@
-#include <dmg/dmg.h>
\ No newline at end of file
+#include <dmg/dmg.h>
+
+#include <string.h>
+
+void dmg_reset(DMGState *state, DMGResetMode mode) {
+    const uint8_t *rom = state->rom;
+    size_t rom_size = state->rom_size;
+    DMGSave *save = state->cart.save;
+    DMGCpuEngine engine = state->cpu.engine;
+
+    // Everything before the caches is machine state
+    memset(state, 0, offsetof(DMGState, blocks));
+    dmg_cpu_invalidate_ram(state);
+    dmg_ppu_invalidate_all(state);
+    state->rom = rom;
+    state->rom_size = rom_size;
+    state->cpu.engine = engine;
+
+    if (mode != DMG_RESET_BIOS) {
+        DMGCpu *cpu = &state->cpu;
+        bool cgb = mode == DMG_RESET_CGB;
+        dmg_mmu_skip_bios(state, cgb);
+        if (cgb) {
+            cpu->af = 0x1180;
+            cpu->bc = 0x0000;
+            cpu->de = 0xFF56;
+            cpu->hl = 0x000D;
+        } else {
+            // H and C are left from adding up the header checksum
+            cpu->af = rom && rom[0x014D] == 0x00 ? 0x0180 : 0x01B0;
+            cpu->bc = 0x0013;
+            cpu->de = 0x00D8;
+            cpu->hl = 0x014D;
+        }
+        cpu->sp = 0xFFFE;
+        cpu->pc = 0x0100;
+    }
+
+    if (rom) {
+        dmg_cart_insert(state, rom, rom_size);
+        if (save) {
+            dmg_cart_attach_save(state, save);
+        }
+    } else {
+        dmg_mmu_unmap(state);
+    }
+}
+
+size_t dmg_run(DMGState *state, DMGVBlankCallback vblank, size_t cycles) {
+    size_t start = state->cycles;
+    size_t end = start + cycles;
+    state->ppu.vblank = vblank;
+    do {
+        dmg_sched_dispatch(state);
+        uint64_t next = dmg_sched_next(state);
+        dmg_cpu_run(state, (size_t) (next < end ? next : end) - state->cycles);
+    } while (state->cycles < end);
+    dmg_sched_dispatch(state);
+    // Leave LY, STAT and the frame buffer up to date for the caller
+    dmg_ppu_sync(state);
+    if (state->cart.save_pending) {
+        state->cart.save_pending = false;
+        dmg_save_flush(state->cart.save);
+    }
+    return state->cycles - start;
+}
@@ -0,0 +1,16 @@
+#include <dmg/irq.h>
+#include <dmg/state.h>
+
+uint8_t dmg_irq_pending(DMGState *state) {
+    return state->mmu.io[DMG_IO_IF] & state->mmu.io[DMG_IO_IE] & 0x1F;
+}
+
+void dmg_irq_raise(DMGState *state, uint8_t bits) {
+    state->mmu.io[DMG_IO_IF] |= bits;
+    dmg_irq_update(state);
+}
+
+void dmg_irq_update(DMGState *state) {
+    DMGCpu *cpu = &state->cpu;
+    cpu->irq = cpu->halted || cpu->halt_bug || cpu->ei || (cpu->ime && dmg_irq_pending(state));
+}
@@ -0,0 +1,902 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <dmg/jit.h>
+
+static_assert(sizeof(size_t) == 8, "the JIT adds to state->cycles as a 64-bit word");
+
+// Total size of the code buffer
+#define DMG_JIT_CODE_SIZE (4 << 20)
+
+// Room reserved for a single block, comfortably above the worst case
+#define DMG_JIT_BLOCK_SIZE 4096
+
+// No SM83 instruction takes longer than this
+#define DMG_JIT_MAX_INSN_CYCLES 24
+
+#define STATE(field) ((int32_t) offsetof(DMGState, field))
+#define CPU(field) STATE(cpu.field)
+
+enum {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+// Guest registers stay in callee-saved host registers for the whole block,
+// so calls back into C do not have to preserve them
+#define HOST_STATE RBX
+#define HOST_SP RBP
+#define HOST_BC R12
+#define HOST_DE R13
+#define HOST_HL R14
+#define HOST_A R15
+
+// Operand forms for emit_op
+#define X86_64 0x01 // REX.W
+#define X86_16 0x02 // Operand-size prefix
+#define X86_8 0x04  // Registers are byte registers
+#define X86_MEM 0x08 // `rm` is [rm + disp32]
+
+enum {
+    CC_C = 0x2,
+    CC_NC = 0x3,
+    CC_Z = 0x4,
+    CC_NZ = 0x5,
+};
+
+// flags_op values not known at translation time
+#define FLAGS_UNKNOWN -1
+
+// Deferred ops that define Z and C, mirroring FLAGS_DEFINED in cpu.c
+#define FLAGS_DEFINE_Z ((1 << DMG_FLAGS_ADD) | (1 << DMG_FLAGS_SUB) | (1 << DMG_FLAGS_INC) | (1 << DMG_FLAGS_DEC))
+#define FLAGS_DEFINE_C ((1 << DMG_FLAGS_ADD) | (1 << DMG_FLAGS_SUB) | (1 << DMG_FLAGS_ADD16))
+
+typedef struct DMGEmitter DMGEmitter;
+struct DMGEmitter {
+    uint8_t *code;
+
+    size_t used;
+
+    size_t size;
+};
+
+static void emit(DMGEmitter *e, uint8_t byte) {
+    if (e->used < e->size) {
+        e->code[e->used] = byte;
+    }
+    e->used++;
+}
+
+static void emit16(DMGEmitter *e, uint16_t word) {
+    emit(e, (uint8_t) word);
+    emit(e, (uint8_t) (word >> 8));
+}
+
+static void emit32(DMGEmitter *e, uint32_t dword) {
+    emit16(e, (uint16_t) dword);
+    emit16(e, (uint16_t) (dword >> 16));
+}
+
+static void emit64(DMGEmitter *e, uint64_t qword) {
+    emit32(e, (uint32_t) qword);
+    emit32(e, (uint32_t) (qword >> 32));
+}
+
+/**
+ * Emits prefixes, a one or two byte opcode and the ModRM byte. `reg` is a
+ * register or an opcode extension, `rm` a register or with X86_MEM the base
+ * of a [base + disp32] operand.
+ */
+static void emit_op(DMGEmitter *e, int form, uint16_t opcode, int reg, int rm, int32_t disp) {
+    if (form & X86_16) {
+        emit(e, 0x66);
+    }
+    uint8_t rex = 0x40;
+    if (form & X86_64) {
+        rex |= 0x08;
+    }
+    if (reg & 8) {
+        rex |= 0x04;
+    }
+    if (rm & 8) {
+        rex |= 0x01;
+    }
+    // Without REX, byte registers 4-7 would be AH-BH instead of SPL-DIL
+    bool low = (form & X86_8) && ((reg >= 4 && reg < 8) || (!(form & X86_MEM) && rm >= 4 && rm < 8));
+    if (rex != 0x40 || low) {
+        emit(e, rex);
+    }
+    if (opcode > 0xFF) {
+        emit(e, (uint8_t) (opcode >> 8));
+    }
+    emit(e, (uint8_t) opcode);
+    if (form & X86_MEM) {
+        emit(e, (uint8_t) (0x80 | (reg & 7) << 3 | (rm & 7)));
+        if ((rm & 7) == RSP) {
+            emit(e, 0x24);
+        }
+        emit32(e, (uint32_t) disp);
+    } else {
+        emit(e, (uint8_t) (0xC0 | (reg & 7) << 3 | (rm & 7)));
+    }
+}
+
+static void emit_mov_imm(DMGEmitter *e, int dst, uint32_t imm) {
+    if (dst & 8) {
+        emit(e, 0x41);
+    }
+    emit(e, (uint8_t) (0xB8 + (dst & 7)));
+    emit32(e, imm);
+}
+
+static void emit_mov_imm64(DMGEmitter *e, int dst, uint64_t imm) {
+    emit(e, (uint8_t) (0x48 | (dst & 8 ? 0x01 : 0x00)));
+    emit(e, (uint8_t) (0xB8 + (dst & 7)));
+    emit64(e, imm);
+}
+
+static void emit_mov(DMGEmitter *e, int dst, int src) {
+    emit_op(e, 0, 0x89, src, dst, 0);
+}
+
+/**
+ * `dst` op= `imm` for the 0x81 group: 0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp
+ */
+static void emit_alu_imm(DMGEmitter *e, int form, int ext, int dst, uint32_t imm) {
+    emit_op(e, form, 0x81, ext, dst, 0);
+    emit32(e, imm);
+}
+
+static void emit_shift(DMGEmitter *e, int ext, int dst, uint8_t n) {
+    emit_op(e, 0, 0xC1, ext, dst, 0);
+    emit(e, n);
+}
+
+static void emit_call(DMGEmitter *e, const void *fn) {
+    emit_mov_imm64(e, RAX, (uint64_t) (uintptr_t) fn);
+    emit_op(e, 0, 0xFF, 2, RAX, 0);
+}
+
+static size_t emit_jcc(DMGEmitter *e, uint8_t cc) {
+    emit(e, 0x0F);
+    emit(e, (uint8_t) (0x80 | cc));
+    emit32(e, 0);
+    return e->used;
+}
+
+static void patch(DMGEmitter *e, size_t at) {
+    if (at <= e->size) {
+        uint32_t rel = (uint32_t) (e->used - at);
+        memcpy(e->code + at - 4, &rel, sizeof(rel));
+    }
+}
+
+static void emit_store8_imm(DMGEmitter *e, int32_t disp, uint8_t imm) {
+    emit_op(e, X86_MEM, 0xC6, 0, HOST_STATE, disp);
+    emit(e, imm);
+}
+
+static void emit_store16_imm(DMGEmitter *e, int32_t disp, uint16_t imm) {
+    emit_op(e, X86_16 | X86_MEM, 0xC7, 0, HOST_STATE, disp);
+    emit16(e, imm);
+}
+
+static void emit_add_cycles(DMGEmitter *e, uint32_t cycles) {
+    if (cycles) {
+        emit_op(e, X86_64 | X86_MEM, 0x81, 0, HOST_STATE, STATE(cycles));
+        emit32(e, cycles);
+    }
+}
+
+static const int PAIRS[4] = {HOST_BC, HOST_DE, HOST_HL, HOST_SP};
+
+static void spill(DMGEmitter *e) {
+    emit_op(e, X86_16 | X86_MEM, 0x89, HOST_BC, HOST_STATE, CPU(bc));
+    emit_op(e, X86_16 | X86_MEM, 0x89, HOST_DE, HOST_STATE, CPU(de));
+    emit_op(e, X86_16 | X86_MEM, 0x89, HOST_HL, HOST_STATE, CPU(hl));
+    emit_op(e, X86_16 | X86_MEM, 0x89, HOST_SP, HOST_STATE, CPU(sp));
+    emit_op(e, X86_8 | X86_MEM, 0x88, HOST_A, HOST_STATE, CPU(a));
+}
+
+static void reload(DMGEmitter *e) {
+    emit_op(e, X86_MEM, 0x0FB7, HOST_BC, HOST_STATE, CPU(bc));
+    emit_op(e, X86_MEM, 0x0FB7, HOST_DE, HOST_STATE, CPU(de));
+    emit_op(e, X86_MEM, 0x0FB7, HOST_HL, HOST_STATE, CPU(hl));
+    emit_op(e, X86_MEM, 0x0FB7, HOST_SP, HOST_STATE, CPU(sp));
+    emit_op(e, X86_MEM, 0x0FB6, HOST_A, HOST_STATE, CPU(a));
+}
+
+static const int SAVED[] = {RBX, RBP, R12, R13, R14, R15};
+
+static void emit_prologue(DMGEmitter *e) {
+    for (size_t i = 0; i < sizeof(SAVED) / sizeof(SAVED[0]); i++) {
+        if (SAVED[i] & 8) {
+            emit(e, 0x41);
+        }
+        emit(e, (uint8_t) (0x50 + (SAVED[i] & 7)));
+    }
+    // Six pushes leave the stack 8 bytes off the call alignment
+    emit_alu_imm(e, X86_64, 5, RSP, 8);
+    emit_op(e, X86_64, 0x89, RDI, HOST_STATE, 0);
+    reload(e);
+}
+
+/**
+ * Leaves the block. `pc` < 0 keeps the pc already in the state.
+ */
+static void emit_exit(DMGEmitter *e, int32_t pc, uint32_t cycles, uint32_t executed, bool spilled) {
+    if (!spilled) {
+        spill(e);
+    }
+    if (pc >= 0) {
+        emit_store16_imm(e, CPU(pc), (uint16_t) pc);
+    }
+    emit_add_cycles(e, cycles);
+    emit_mov_imm(e, RAX, executed);
+    emit_alu_imm(e, X86_64, 0, RSP, 8);
+    for (size_t i = sizeof(SAVED) / sizeof(SAVED[0]); i-- > 0;) {
+        if (SAVED[i] & 8) {
+            emit(e, 0x41);
+        }
+        emit(e, (uint8_t) (0x58 + (SAVED[i] & 7)));
+    }
+    emit(e, 0xC3);
+}
+
+/**
+ * Loads 8-bit guest register `r` (SM83 encoding, B C D E H L - A) into `dst`
+ */
+static void get_r(DMGEmitter *e, int dst, uint8_t r) {
+    if (r == 7) {
+        emit_mov(e, dst, HOST_A);
+    } else if (r & 1) {
+        emit_op(e, X86_8, 0x0FB6, dst, PAIRS[r >> 1], 0);
+    } else {
+        emit_mov(e, dst, PAIRS[r >> 1]);
+        emit_shift(e, 5, dst, 8);
+    }
+}
+
+/**
+ * Stores `src`, which must hold a byte, into guest register `r`. Clobbers `src`.
+ */
+static void set_r(DMGEmitter *e, uint8_t r, int src) {
+    if (r == 7) {
+        emit_mov(e, HOST_A, src);
+    } else if (r & 1) {
+        emit_alu_imm(e, 0, 4, PAIRS[r >> 1], 0xFF00);
+        emit_op(e, 0, 0x09, src, PAIRS[r >> 1], 0);
+    } else {
+        emit_alu_imm(e, 0, 4, PAIRS[r >> 1], 0x00FF);
+        emit_shift(e, 4, src, 8);
+        emit_op(e, 0, 0x09, src, PAIRS[r >> 1], 0);
+    }
+}
+
+#ifdef DMG_LAZY_FLAGS
+
+/**
+ * Stores a deferred flags record, see defer_flags in cpu.c. `lhs`, `rhs`
+ * and `result` are host registers.
+ */
+static void emit_defer(DMGEmitter *e, uint8_t op, int lhs, int rhs, int result) {
+    emit_store8_imm(e, CPU(flags_op), op);
+    emit_op(e, X86_16 | X86_MEM, 0x89, lhs, HOST_STATE, CPU(flags_lhs));
+    if (rhs < 0) {
+        emit_store16_imm(e, CPU(flags_rhs), 1);
+    } else {
+        emit_op(e, X86_16 | X86_MEM, 0x89, rhs, HOST_STATE, CPU(flags_rhs));
+    }
+    emit_op(e, X86_MEM, 0x89, result, HOST_STATE, CPU(flags_result));
+}
+
+#endif
+
+/**
+ * Folds pending flags into `f` if they define C, see keep_flags in cpu.c
+ */
+static void emit_keep_c(DMGEmitter *e, int known) {
+#ifdef DMG_LAZY_FLAGS
+    size_t skip = 0;
+    if (known == FLAGS_UNKNOWN) {
+        emit_op(e, X86_MEM, 0x0FB6, RAX, HOST_STATE, CPU(flags_op));
+        emit_mov_imm(e, RCX, FLAGS_DEFINE_C);
+        emit_op(e, 0, 0x0FA3, RAX, RCX, 0);
+        skip = emit_jcc(e, CC_NC);
+    } else if (!(FLAGS_DEFINE_C & (1 << known))) {
+        return;
+    }
+    emit_op(e, X86_64 | X86_MEM, 0x8D, RDI, HOST_STATE, STATE(cpu));
+    emit_call(e, dmg_cpu_flags);
+    if (skip) {
+        patch(e, skip);
+    }
+#endif
+}
+
+/**
+ * Sets AL to Z (`flag` 0x80) or C (0x10), see get_z and get_c in cpu.c
+ */
+static void emit_flag(DMGEmitter *e, uint8_t flag, int known) {
+#ifdef DMG_LAZY_FLAGS
+    uint32_t defining = flag == 0x80 ? FLAGS_DEFINE_Z : FLAGS_DEFINE_C;
+    if (known == FLAGS_UNKNOWN) {
+        size_t tails[2];
+        size_t count = 0;
+        emit_op(e, X86_MEM, 0x0FB6, RAX, HOST_STATE, CPU(flags_op));
+        size_t wide = 0;
+        if (flag == 0x10) {
+            emit_alu_imm(e, 0, 7, RAX, DMG_FLAGS_ADD16);
+            wide = emit_jcc(e, CC_Z);
+        }
+        emit_mov_imm(e, RCX, defining & ~(1u << DMG_FLAGS_ADD16));
+        emit_op(e, 0, 0x0FA3, RAX, RCX, 0);
+        size_t stored = emit_jcc(e, CC_NC);
+        if (flag == 0x80) {
+            emit_op(e, X86_MEM, 0x80, 7, HOST_STATE, CPU(flags_result));
+            emit(e, 0x00);
+            emit_op(e, X86_8, 0x0F90 | CC_Z, 0, RAX, 0);
+        } else {
+            emit_op(e, X86_MEM, 0xF6, 0, HOST_STATE, CPU(flags_result) + 1);
+            emit(e, 0x01);
+            emit_op(e, X86_8, 0x0F90 | CC_NZ, 0, RAX, 0);
+        }
+        emit(e, 0xE9);
+        emit32(e, 0);
+        tails[count++] = e->used;
+        if (wide) {
+            patch(e, wide);
+            emit_op(e, X86_MEM, 0xF6, 0, HOST_STATE, CPU(flags_result) + 2);
+            emit(e, 0x01);
+            emit_op(e, X86_8, 0x0F90 | CC_NZ, 0, RAX, 0);
+            emit(e, 0xE9);
+            emit32(e, 0);
+            tails[count++] = e->used;
+        }
+        patch(e, stored);
+        emit_op(e, X86_MEM, 0xF6, 0, HOST_STATE, CPU(f));
+        emit(e, flag);
+        emit_op(e, X86_8, 0x0F90 | CC_NZ, 0, RAX, 0);
+        while (count--) {
+            patch(e, tails[count]);
+        }
+        return;
+    }
+    if (defining & (1 << known)) {
+        if (flag == 0x80) {
+            emit_op(e, X86_MEM, 0x80, 7, HOST_STATE, CPU(flags_result));
+            emit(e, 0x00);
+            emit_op(e, X86_8, 0x0F90 | CC_Z, 0, RAX, 0);
+        } else {
+            emit_op(e, X86_MEM, 0xF6, 0, HOST_STATE, CPU(flags_result) + (known == DMG_FLAGS_ADD16 ? 2 : 1));
+            emit(e, 0x01);
+            emit_op(e, X86_8, 0x0F90 | CC_NZ, 0, RAX, 0);
+        }
+        return;
+    }
+#endif
+    emit_op(e, X86_MEM, 0xF6, 0, HOST_STATE, CPU(f));
+    emit(e, flag);
+    emit_op(e, X86_8, 0x0F90 | CC_NZ, 0, RAX, 0);
+}
+
+/**
+ * Ends the block with a conditional jump. `cond` is the SM83 condition (NZ,
+ * Z, NC, C).
+ */
+static void emit_branch(DMGEmitter *e, uint8_t cond, int known, uint16_t target, uint16_t next,
+                        uint32_t pending, uint32_t executed) {
+    emit_flag(e, (cond & 2) ? 0x10 : 0x80, known);
+    emit_op(e, X86_8, 0x84, RAX, RAX, 0);
+    size_t skip = emit_jcc(e, (cond & 1) ? CC_Z : CC_NZ);
+    emit_exit(e, target, pending + 4, executed, false);
+    patch(e, skip);
+    emit_exit(e, next, pending, executed, false);
+}
+
+/**
+ * True for instructions that talk to IO registers through a fixed address.
+ * Blocks containing them stay with the interpreter.
+ */
+static bool touches_io(const DMGInsn *insn) {
+    switch (insn->opcode) {
+        case 0xE0: // LDH (N), A
+        case 0xE2: // LD (C), A
+        case 0xF0: // LDH A, (N)
+        case 0xF2: // LD A, (C)
+            return true;
+        case 0xEA: // LD (NN), A
+        case 0xFA: // LD A, (NN)
+            return insn->operand >= 0xFF00;
+        default:
+            break;
+    }
+    return false;
+}
+
+typedef struct DMGTranslation DMGTranslation;
+
+/**
+ * What the translator knows between instructions of a block
+ */
+struct DMGTranslation {
+    DMGEmitter e;
+
+    /**
+     * flags_op left by the previous instruction, or FLAGS_UNKNOWN
+     */
+    int known;
+
+    /**
+     * Cycles not yet added to state->cycles
+     */
+    uint32_t pending;
+
+    /**
+     * Upper bound on the cycles taken so far
+     */
+    uint32_t bound;
+
+    /**
+     * Set when the current instruction wrote to memory
+     */
+    bool wrote;
+};
+
+/**
+ * Calls dmg_mmu_read on the guest address in host register `address`,
+ * leaving the byte in EAX
+ */
+static void emit_mmu_read(DMGEmitter *e, int address) {
+    emit_mov(e, RSI, address);
+    emit_op(e, X86_64, 0x89, HOST_STATE, RDI, 0);
+    emit_call(e, dmg_mmu_read);
+    emit_op(e, X86_8, 0x0FB6, RAX, RAX, 0);
+}
+
+static void emit_mmu_write(DMGEmitter *e, int address, int value) {
+    emit_mov(e, RDX, value);
+    emit_mov(e, RSI, address);
+    emit_op(e, X86_64, 0x89, HOST_STATE, RDI, 0);
+    emit_call(e, dmg_mmu_write);
+}
+
+/**
+ * A single memory access, charged like read8 in cpu.c
+ */
+static void emit_read(DMGTranslation *t, int address) {
+    emit_add_cycles(&t->e, t->pending + 4);
+    t->pending = 0;
+    t->bound += 4;
+    emit_mmu_read(&t->e, address);
+}
+
+static void emit_write(DMGTranslation *t, int address, int value) {
+    emit_add_cycles(&t->e, t->pending + 4);
+    t->pending = 0;
+    t->bound += 4;
+    emit_mmu_write(&t->e, address, value);
+    t->wrote = true;
+}
+
+/**
+ * CALL NN, see call_nn in cpu.c. Ends the block.
+ */
+static void emit_call_nn(DMGTranslation *t, uint16_t nn, uint16_t next, uint32_t executed) {
+    DMGEmitter *e = &t->e;
+    emit_op(e, X86_16, 0xFF, 1, HOST_SP, 0);
+    emit_op(e, X86_16, 0xFF, 1, HOST_SP, 0);
+    emit_add_cycles(e, t->pending + 8);
+    emit_mov_imm(e, RCX, next & 0xFF);
+    emit_mmu_write(e, HOST_SP, RCX);
+    emit_mov(e, RAX, HOST_SP);
+    emit_op(e, X86_16, 0xFF, 0, RAX, 0);
+    emit_mov_imm(e, RCX, next >> 8);
+    emit_mmu_write(e, RAX, RCX);
+    emit_exit(e, nn, 4, executed, false);
+    t->bound += 12;
+}
+
+/**
+ * RET, see ret in cpu.c. Ends the block.
+ */
+static void emit_ret(DMGTranslation *t, uint32_t executed) {
+    DMGEmitter *e = &t->e;
+    emit_add_cycles(e, t->pending + 12);
+    emit_mmu_read(e, HOST_SP);
+    // The low byte waits in the alignment slot of the frame
+    emit_op(e, X86_MEM, 0x89, RAX, RSP, 0);
+    emit_mov(e, RCX, HOST_SP);
+    emit_op(e, X86_16, 0xFF, 0, RCX, 0);
+    emit_mmu_read(e, RCX);
+    emit_shift(e, 4, RAX, 8);
+    emit_op(e, X86_MEM, 0x0B, RAX, RSP, 0);
+    emit_op(e, X86_16 | X86_MEM, 0x89, RAX, HOST_STATE, CPU(pc));
+    emit_op(e, X86_16, 0xFF, 0, HOST_SP, 0);
+    emit_op(e, X86_16, 0xFF, 0, HOST_SP, 0);
+    emit_exit(e, -1, 0, executed, false);
+    t->bound += 12;
+}
+
+/**
+ * Sets `f` to Z from `value` (not EAX) plus the constant `bits`, see set_flags
+ */
+static void emit_set_flags(DMGTranslation *t, int value, uint8_t bits) {
+    DMGEmitter *e = &t->e;
+    emit_op(e, 0, 0x31, RAX, RAX, 0);
+    emit_op(e, 0, 0x85, value, value, 0);
+    emit_op(e, X86_8, 0x0F90 | CC_Z, 0, RAX, 0);
+    emit_shift(e, 4, RAX, 7);
+    if (bits) {
+        emit_alu_imm(e, 0, 1, RAX, bits);
+    }
+    emit_op(e, X86_8 | X86_MEM, 0x88, RAX, HOST_STATE, CPU(f));
+    emit_store8_imm(e, CPU(flags_op), DMG_FLAGS_NONE);
+    t->known = DMG_FLAGS_NONE;
+}
+
+/**
+ * True for the ALU ops on A (ADD ADC SUB SBC AND XOR OR CP) that are emitted
+ * inline. The others need the carry and go through their handlers.
+ */
+static bool alu_inline(uint8_t alu) {
+    switch (alu) {
+#ifdef DMG_LAZY_FLAGS
+        case 0:
+        case 2:
+        case 7:
+#endif
+        case 4:
+        case 5:
+        case 6:
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+/**
+ * A op= ECX for ALU op `alu`, see add_r, sub_r, and_r and friends in cpu.c
+ */
+static void emit_alu(DMGTranslation *t, uint8_t alu) {
+    DMGEmitter *e = &t->e;
+    switch (alu) {
+#ifdef DMG_LAZY_FLAGS
+        case 0: // ADD
+            emit_mov(e, RAX, HOST_A);
+            emit_op(e, 0, 0x01, RCX, RAX, 0);
+            emit_defer(e, DMG_FLAGS_ADD, HOST_A, RCX, RAX);
+            emit_op(e, X86_8, 0x0FB6, HOST_A, RAX, 0);
+            t->known = DMG_FLAGS_ADD;
+            break;
+        case 2: // SUB
+        case 7: // CP
+            emit_mov(e, RAX, HOST_A);
+            emit_op(e, 0, 0x29, RCX, RAX, 0);
+            emit_alu_imm(e, 0, 4, RAX, 0xFFFF);
+            emit_defer(e, DMG_FLAGS_SUB, HOST_A, RCX, RAX);
+            if (alu == 2) {
+                emit_op(e, X86_8, 0x0FB6, HOST_A, RAX, 0);
+            }
+            t->known = DMG_FLAGS_SUB;
+            break;
+#endif
+        default: // AND, XOR, OR
+            emit_op(e, 0, alu == 4 ? 0x21 : alu == 5 ? 0x31 : 0x09, RCX, HOST_A, 0);
+            emit_set_flags(t, HOST_A, alu == 4 ? 0x20 : 0x00);
+            break;
+    }
+}
+
+/**
+ * CB-prefixed ops on registers: BIT, RES, SET and SWAP
+ */
+static bool emit_cb(DMGTranslation *t, uint8_t op) {
+    DMGEmitter *e = &t->e;
+    uint8_t n = (uint8_t) ((op >> 3) & 0x07);
+    uint8_t r = (uint8_t) (op & 0x07);
+    if (r == 6) {
+        return false;
+    }
+    // Bit `n` of register `r` within its host register
+    uint32_t mask = 1u << (r == 7 || (r & 1) ? n : n + 8);
+    int host = r == 7 ? HOST_A : PAIRS[r >> 1];
+    if (op >= 0xC0) { // SET
+        emit_alu_imm(e, 0, 1, host, mask);
+        return true;
+    }
+    if (op >= 0x80) { // RES
+        emit_alu_imm(e, 0, 4, host, ~mask);
+        return true;
+    }
+    if (op >= 0x40) { // BIT, see bit_r
+        emit_keep_c(e, t->known);
+        emit_op(e, X86_MEM, 0x0FB6, RAX, HOST_STATE, CPU(f));
+        emit_alu_imm(e, 0, 4, RAX, 0x10);
+        emit_op(e, 0, 0xF7, 0, host, 0);
+        emit32(e, mask);
+        emit_op(e, X86_8, 0x0F90 | CC_Z, 0, RDX, 0);
+        emit_op(e, X86_8, 0x0FB6, RDX, RDX, 0);
+        emit_shift(e, 4, RDX, 7);
+        emit_op(e, 0, 0x09, RDX, RAX, 0);
+        emit_alu_imm(e, 0, 1, RAX, 0x20);
+        emit_op(e, X86_8 | X86_MEM, 0x88, RAX, HOST_STATE, CPU(f));
+        emit_store8_imm(e, CPU(flags_op), DMG_FLAGS_NONE);
+        t->known = DMG_FLAGS_NONE;
+        return true;
+    }
+    if (op >= 0x30 && op < 0x38) { // SWAP
+        get_r(e, RCX, r);
+        emit_mov(e, RDX, RCX);
+        emit_shift(e, 5, RCX, 4);
+        emit_shift(e, 4, RDX, 4);
+        emit_op(e, 0, 0x09, RDX, RCX, 0);
+        emit_alu_imm(e, 0, 4, RCX, 0xFF);
+        emit_set_flags(t, RCX, 0x00);
+        set_r(e, r, RCX);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Control transfers emitted inline, which leave the block themselves
+ */
+static bool is_jump(uint8_t op) {
+    return op == 0x18 || op == 0xC3 || op == 0xC9 || op == 0xCD || (op & 0xE7) == 0x20 || (op & 0xE7) == 0xC2;
+}
+
+/**
+ * Emits `insn` inline, `next` being the address after it. Returns false if
+ * it has to be run by its handler, in which case nothing was emitted.
+ */
+static bool emit_insn(DMGTranslation *t, const DMGInsn *insn, uint16_t next, uint32_t executed) {
+    DMGEmitter *e = &t->e;
+    uint8_t op = insn->opcode;
+    uint8_t r = (uint8_t) ((op >> 3) & 0x07);
+    uint8_t r2 = (uint8_t) (op & 0x07);
+
+    if (op == 0x00) { // NOP
+        return true;
+    }
+    if (op == 0xCB) {
+        return emit_cb(t, (uint8_t) insn->operand);
+    }
+    if ((op & 0xCF) == 0x01) { // LD RR, NN
+        emit_mov_imm(e, PAIRS[op >> 4], insn->operand);
+        return true;
+    }
+    if ((op & 0xC7) == 0x03) { // INC RR / DEC RR
+        emit_op(e, X86_16, 0xFF, (op & 0x08) ? 1 : 0, PAIRS[op >> 4], 0);
+        t->pending += 4;
+        t->bound += 4;
+        return true;
+    }
+    if ((op & 0xC7) == 0x06 && r != 6) { // LD R, N
+        emit_mov_imm(e, RAX, insn->operand);
+        set_r(e, r, RAX);
+        return true;
+    }
+    if (op >= 0x40 && op < 0x80 && op != 0x76) {
+        if (r2 == 6) { // LD R, (HL)
+            emit_read(t, HOST_HL);
+            set_r(e, r, RAX);
+        } else if (r == 6) { // LD (HL), R
+            get_r(e, RCX, r2);
+            emit_write(t, HOST_HL, RCX);
+        } else { // LD R, R
+            get_r(e, RAX, r2);
+            set_r(e, r, RAX);
+        }
+        return true;
+    }
+    switch (op) {
+        case 0x36: // LD (HL), N
+            emit_mov_imm(e, RCX, insn->operand);
+            emit_write(t, HOST_HL, RCX);
+            return true;
+        case 0x02: // LD (BC), A
+        case 0x12: // LD (DE), A
+            emit_write(t, PAIRS[op >> 4], HOST_A);
+            return true;
+        case 0x0A: // LD A, (BC)
+        case 0x1A: // LD A, (DE)
+            emit_read(t, PAIRS[op >> 4]);
+            emit_mov(e, HOST_A, RAX);
+            return true;
+        case 0x22: // LDI (HL), A
+        case 0x32: // LDD (HL), A
+            emit_write(t, HOST_HL, HOST_A);
+            emit_op(e, X86_16, 0xFF, op == 0x32 ? 1 : 0, HOST_HL, 0);
+            return true;
+        case 0x2A: // LDI A, (HL)
+        case 0x3A: // LDD A, (HL)
+            emit_read(t, HOST_HL);
+            emit_mov(e, HOST_A, RAX);
+            emit_op(e, X86_16, 0xFF, op == 0x3A ? 1 : 0, HOST_HL, 0);
+            return true;
+        case 0x18: // JR N
+            emit_exit(e, (uint16_t) (next + (int8_t) insn->operand), t->pending + 4, executed, false);
+            t->bound += 4;
+            return true;
+        case 0xC3: // JP NN
+            emit_exit(e, insn->operand, t->pending + 4, executed, false);
+            t->bound += 4;
+            return true;
+        case 0xCD: // CALL NN
+            emit_call_nn(t, insn->operand, next, executed);
+            return true;
+        case 0xC9: // RET
+            emit_ret(t, executed);
+            return true;
+        default:
+            break;
+    }
+    if ((op & 0xE7) == 0x20) { // JR CC, N
+        emit_branch(e, r & 0x03, t->known, (uint16_t) (next + (int8_t) insn->operand), next, t->pending, executed);
+        t->bound += 4;
+        return true;
+    }
+    if ((op & 0xE7) == 0xC2) { // JP CC, NN
+        emit_branch(e, r & 0x03, t->known, insn->operand, next, t->pending, executed);
+        t->bound += 4;
+        return true;
+    }
+#ifdef DMG_LAZY_FLAGS
+    if ((op & 0xC6) == 0x04 && r != 6) { // INC R / DEC R, see inc_r and dec_r
+        bool dec = (op & 0x01) != 0x00;
+        emit_keep_c(e, t->known);
+        get_r(e, RCX, r);
+        emit_mov(e, RAX, RCX);
+        emit_alu_imm(e, 0, dec ? 5 : 0, RAX, 1);
+        emit_op(e, X86_8, 0x0FB6, RAX, RAX, 0);
+        emit_defer(e, dec ? DMG_FLAGS_DEC : DMG_FLAGS_INC, RCX, -1, RAX);
+        set_r(e, r, RAX);
+        t->known = dec ? DMG_FLAGS_DEC : DMG_FLAGS_INC;
+        return true;
+    }
+#endif
+
+    // ALU ops on A with a register, (HL) or an immediate
+    if (op >= 0x80 && op < 0xC0 && alu_inline(r)) {
+        if (r2 == 6) {
+            emit_read(t, HOST_HL);
+            emit_mov(e, RCX, RAX);
+        } else {
+            get_r(e, RCX, r2);
+        }
+        emit_alu(t, r);
+        return true;
+    }
+    if ((op & 0xC7) == 0xC6 && alu_inline(r)) {
+        emit_mov_imm(e, RCX, insn->operand);
+        emit_alu(t, r);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Sets the protection of the pages holding the `length` bytes at `code`.
+ * Code is never writable and executable at once, so that it also runs where
+ * W^X is enforced.
+ */
+static bool protect(uint8_t *code, size_t length, int prot) {
+    uintptr_t page = (uintptr_t) sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t) code & ~(page - 1);
+    uintptr_t end = ((uintptr_t) code + length + page - 1) & ~(page - 1);
+    return mprotect((void *) start, end - start, prot) == 0;
+}
+
+static void flush(DMGState *state) {
+    DMGBlockCache *cache = &state->blocks;
+    for (size_t i = 0; i < DMG_BLOCK_CACHE_SIZE; i++) {
+        cache->blocks[i].native = NULL;
+        cache->blocks[i].hits = 0;
+    }
+    state->jit.used = 0;
+}
+
+void dmg_jit_compile(DMGState *state, DMGBlock *block) {
+    DMGJit *jit = &state->jit;
+
+    // Code in RAM can be rewritten under us, leave it to the block engine
+    bool translatable = block->start < 0x8000;
+    for (size_t i = 0; i < block->count; i++) {
+        translatable = translatable && !touches_io(&block->insns[i]);
+    }
+    if (!translatable) {
+        return;
+    }
+
+    if (!jit->code) {
+        void *code = mmap(NULL, DMG_JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            return;
+        }
+        jit->code = code;
+        jit->size = DMG_JIT_CODE_SIZE;
+        jit->used = 0;
+    }
+    if (jit->size - jit->used < DMG_JIT_BLOCK_SIZE) {
+        flush(state);
+    }
+
+    // Writable only while this block is emitted
+    uint8_t *code = jit->code + jit->used;
+    if (!protect(code, DMG_JIT_BLOCK_SIZE, PROT_READ | PROT_WRITE)) {
+        return;
+    }
+    DMGTranslation t = {{code, 0, DMG_JIT_BLOCK_SIZE}, FLAGS_UNKNOWN, 0, 0, false};
+    DMGEmitter *e = &t.e;
+    uint16_t pc = block->start;
+    emit_prologue(e);
+    for (uint32_t i = 0; i < block->count; i++) {
+        const DMGInsn *insn = &block->insns[i];
+        uint16_t next = (uint16_t) (pc + insn->length);
+        bool last = i + 1 == block->count;
+        t.pending += insn->cycles;
+        t.bound += insn->cycles;
+        t.wrote = false;
+        pc = next;
+        if (emit_insn(&t, insn, next, i + 1)) {
+            if (last && !is_jump(insn->opcode)) {
+                emit_exit(e, next, t.pending, i + 1, false);
+            } else if (t.wrote && !last) {
+                // Stop if the write hit cached code or interrupt state
+                emit_op(e, X86_MEM, 0x80, 7, HOST_STATE, STATE(blocks.dirty));
+                emit(e, 0x00);
+                size_t resume = emit_jcc(e, CC_Z);
+                emit_exit(e, next, t.pending, i + 1, false);
+                patch(e, resume);
+            }
+            continue;
+        }
+
+        // Everything else goes through the block engine's handler with the
+        // guest state written back
+        t.bound += DMG_JIT_MAX_INSN_CYCLES - insn->cycles;
+        spill(e);
+        emit_store16_imm(e, CPU(pc), next);
+        emit_add_cycles(e, t.pending);
+        t.pending = 0;
+        emit_op(e, X86_64, 0x89, HOST_STATE, RDI, 0);
+        emit_mov_imm64(e, RSI, (uint64_t) (uintptr_t) insn);
+        emit_call(e, (const void *) insn->handler);
+        t.known = FLAGS_UNKNOWN;
+        if (last) {
+            emit_exit(e, -1, 0, i + 1, true);
+        } else {
+            emit_op(e, X86_MEM, 0x80, 7, HOST_STATE, STATE(blocks.dirty));
+            emit(e, 0x00);
+            size_t resume = emit_jcc(e, CC_Z);
+            emit_exit(e, -1, 0, i + 1, true);
+            patch(e, resume);
+            reload(e);
+        }
+    }
+
+    if (!protect(code, DMG_JIT_BLOCK_SIZE, PROT_READ | PROT_EXEC)) {
+        // Blocks sharing its pages cannot run either
+        flush(state);
+        return;
+    }
+    if (e->used > e->size) {
+        return;
+    }
+    block->native = e->code;
+    block->native_cycles = (uint16_t) t.bound;
+    jit->used += (e->used + 15) & ~(size_t) 15;
+}
+
+void dmg_jit_free(DMGState *state) {
+    DMGJit *jit = &state->jit;
+    if (jit->code) {
+        flush(state);
+        munmap(jit->code, jit->size);
+        jit->code = NULL;
+        jit->size = 0;
+    }
+}
@@ -1,5 +1,19 @@
 #include <dmg/mmu.h>
+#include <dmg/cart.h>
+#include <dmg/cpu.h>
+#include <dmg/irq.h>
+#include <dmg/ppu.h>
+#include <dmg/sched.h>
 #include <dmg/state.h>
+#include <dmg/timer.h>
+
+#include <string.h>
+
+// 160 M-cycles
+#define DMG_DMA_CYCLES 640
+
+// The CPU is stalled for 8 M-cycles per 16 byte HDMA block
+#define DMG_HDMA_BLOCK_CYCLES 32
 
 static const uint8_t BIOS[256] = {
         0x31, 0xFE, 0xFF, 0xAF, 0x21, 0xFF, 0x9F, 0x32, 0xCB, 0x7C, 0x20, 0xFB, 0x21, 0x26, 0xFF, 0x0E,
@@ -20,89 +34,541 @@ static const uint8_t BIOS[256] = {
         0xF5, 0x06, 0x19, 0x78, 0x86, 0x23, 0x05, 0x20, 0xFB, 0x86, 0x20, 0xFE, 0x3E, 0x01, 0xE0, 0x50
 };
 
-uint8_t dmg_mmu_read(DMGState *state, uint16_t address) {
+/**
+ * Catches the PPU up before the CPU touches anything it shares with it
+ */
+static DMG_INLINE void sync_ppu(DMGState *state) {
+    if (state->ppu.next <= state->cycles) {
+        dmg_ppu_sync(state);
+    }
+}
+
+/**
+ * Host address of the RAM at 0xA000-0xDFFF under the current banks, NULL
+ * while the cartridge maps something else there
+ */
+static uint8_t *ram_at(DMGState *state, uint16_t address) {
+    DMGMmu *mmu = &state->mmu;
+    if (address < 0xC000) {
+        uint8_t *bank = dmg_cart_ram(state);
+        return bank ? &bank[(address - 0xA000) & state->cart.ram_mask] : NULL;
+    } else if (address < 0xD000) {
+        return &mmu->wram[address - 0xC000];
+    }
+    return &mmu->sram[mmu->io[DMG_IO_SVBK] & 0x07][address - 0xD000];
+}
+
+/**
+ * Host address of plain memory at `address` under the current banks, NULL
+ * where accesses have to go through the handlers below (BIOS, OAM, IO)
+ */
+static const uint8_t *memory_at(DMGState *state, uint16_t address) {
     DMGMmu *mmu = &state->mmu;
     switch (address & 0xF000) {
         case 0x0000:
             if (mmu->io[DMG_IO_BIOS] == 0x00 && address < 0x0100) {
-                return BIOS[address];
+                return NULL;
             }
+            // fallthrough
         case 0x1000:
         case 0x2000:
         case 0x3000:
+            return &state->cart.rom0[address];
+
         case 0x4000:
         case 0x5000:
         case 0x6000:
         case 0x7000:
-            return state->rom[address];
+            return &state->cart.romx[address - 0x4000];
 
         case 0x8000:
         case 0x9000:
-            return mmu->vram[mmu->io[DMG_IO_VBK] & 0x01][address - 0x8000];
+            return &mmu->vram[mmu->io[DMG_IO_VBK] & 0x01][address - 0x8000];
 
         case 0xA000:
         case 0xB000:
-            return mmu->cram[address - 0xA000];
-
         case 0xC000:
-            return mmu->wram[address - 0xC000];
-
         case 0xD000:
-            return mmu->sram[mmu->io[DMG_IO_SVBK] & 0x07][address - 0xD000];
-
-        case 0xE000:
-        case 0xF000:
-            if (address <= (uint16_t) 0xFDFF) {
-                return dmg_mmu_read(state, (uint16_t) (address - 0x2000));
-            } else if (address <= 0xFE9F) {
-                return mmu->oam[address - 0xFE00];
-            } else if (address <= 0xFF7F || address == 0xFFFF) {
-                return mmu->io[address - 0xFF00];
-            } else {
-                return mmu->hram[address - 0xFF80];
-            }
+            return ram_at(state, address);
 
         default:
+            // Echo RAM
+            if (address <= 0xFDFF) {
+                return memory_at(state, (uint16_t) (address - 0x2000));
+            }
             break;
     }
-    assert(false);
-    return 0;
+    return NULL;
 }
 
-void dmg_mmu_write(DMGState *state, uint16_t address, uint8_t byte) {
+/**
+ * Drops the mappings of the pages from `start` to `end` after the memory
+ * behind them changed, they are mapped again on their next access
+ */
+static void unmap(DMGState *state, uint16_t start, uint16_t end) {
+    for (size_t page = start >> 8; page <= (size_t) (end >> 8); page++) {
+        state->pages.read[page] = NULL;
+        state->pages.write[page] = NULL;
+    }
+}
+
+typedef uint8_t (*DMGIORead)(DMGState *state, uint8_t port);
+
+typedef void (*DMGIOWrite)(DMGState *state, uint8_t port, uint8_t byte);
+
+// LY and the mode bits of STAT
+static uint8_t read_ppu(DMGState *state, uint8_t port) {
+    sync_ppu(state);
+    return state->mmu.io[port];
+}
+
+static uint8_t read_stat(DMGState *state, uint8_t port) {
+    sync_ppu(state);
+    return (uint8_t) (state->mmu.io[port] | 0x80);
+}
+
+static uint8_t read_write_only(DMGState *state, uint8_t port) {
+    return 0xFF;
+}
+
+static uint8_t read_div(DMGState *state, uint8_t port) {
+    return dmg_timer_div(state);
+}
+
+static uint8_t read_tima(DMGState *state, uint8_t port) {
+    dmg_timer_sync(state);
+    return state->mmu.io[port];
+}
+
+static uint8_t read_tac(DMGState *state, uint8_t port) {
+    return (uint8_t) (state->mmu.io[port] | 0xF8);
+}
+
+static uint8_t read_if(DMGState *state, uint8_t port) {
+    return (uint8_t) (state->mmu.io[port] | 0xE0);
+}
+
+// Registers the PPU reads while rendering
+static void write_ppu(DMGState *state, uint8_t port, uint8_t byte) {
+    sync_ppu(state);
+    state->mmu.io[port] = byte;
+}
+
+static void write_lcdc(DMGState *state, uint8_t port, uint8_t byte) {
+    sync_ppu(state);
+    uint8_t old = state->mmu.io[port];
+    state->mmu.io[port] = byte;
+    if ((old ^ byte) & 0x80) {
+        dmg_ppu_lcd_switched(state);
+    }
+}
+
+static void write_stat(DMGState *state, uint8_t port, uint8_t byte) {
+    sync_ppu(state);
+    // Mode and coincidence bits belong to the PPU
+    state->mmu.io[port] = (uint8_t) ((byte & 0x78) | (state->mmu.io[port] & 0x07));
+    dmg_ppu_reschedule(state);
+}
+
+static void write_lyc(DMGState *state, uint8_t port, uint8_t byte) {
+    sync_ppu(state);
+    state->mmu.io[port] = byte;
+    dmg_ppu_reschedule(state);
+}
+
+static void write_read_only(DMGState *state, uint8_t port, uint8_t byte) {
+}
+
+static void write_timer(DMGState *state, uint8_t port, uint8_t byte) {
+    dmg_timer_write(state, port, byte);
+}
+
+static void write_interrupts(DMGState *state, uint8_t port, uint8_t byte) {
+    // IF only has the five request bits, the rest read as 1
+    state->mmu.io[port] = port == DMG_IO_IF ? (uint8_t) (byte & 0x1F) : byte;
+    dmg_irq_update(state);
+    // Cached blocks assume interrupts stay put
+    state->blocks.dirty = true;
+}
+
+/**
+ * Copies the 160 bytes at `byte` << 8 into OAM in one go and holds the bus
+ * until the time the hardware takes to do it byte by byte has passed
+ */
+static void write_dma(DMGState *state, uint8_t port, uint8_t byte) {
+    DMGMmu *mmu = &state->mmu;
+    sync_ppu(state);
+    mmu->io[port] = byte;
+    // Sources past 0xDFFF read the RAM behind echo RAM
+    uint16_t source = (uint16_t) ((byte >= 0xE0 ? byte - 0x20 : byte) << 8);
+    const uint8_t *memory = memory_at(state, source);
+    if (memory) {
+        memcpy(mmu->oam, memory, sizeof(mmu->oam));
+    } else {
+        for (uint16_t i = 0; i < sizeof(mmu->oam); i++) {
+            mmu->oam[i] = dmg_mmu_read(state, (uint16_t) (source + i));
+        }
+    }
+    dmg_ppu_invalidate_oam(state);
+    mmu->dma = true;
+    dmg_sched_post(state, DMG_EVENT_DMA, state->cycles + DMG_DMA_CYCLES);
+}
+
+/**
+ * Copies `blocks` HDMA blocks into the selected VRAM bank, a source page at a
+ * time, and stalls the CPU for them
+ */
+static void hdma_copy(DMGState *state, uint8_t blocks) {
+    DMGMmu *mmu = &state->mmu;
+    uint8_t bank = mmu->io[DMG_IO_VBK] & 0x01;
+    uint8_t *vram = mmu->vram[bank];
+    size_t length = (size_t) blocks * 16;
+    while (length) {
+        size_t chunk = 0x100 - (mmu->hdma_source & 0xFF);
+        if (chunk > 0x2000u - mmu->hdma_dest) {
+            chunk = 0x2000u - mmu->hdma_dest;
+        }
+        if (chunk > length) {
+            chunk = length;
+        }
+        const uint8_t *memory = memory_at(state, mmu->hdma_source);
+        if (memory) {
+            memcpy(&vram[mmu->hdma_dest], memory, chunk);
+        } else {
+            for (size_t i = 0; i < chunk; i++) {
+                vram[mmu->hdma_dest + i] = dmg_mmu_read(state, (uint16_t) (mmu->hdma_source + i));
+            }
+        }
+        dmg_ppu_invalidate(state, bank, mmu->hdma_dest, (uint16_t) chunk);
+        mmu->hdma_source = (uint16_t) (mmu->hdma_source + chunk);
+        mmu->hdma_dest = (uint16_t) ((mmu->hdma_dest + chunk) & 0x1FFF);
+        length -= chunk;
+    }
+    state->cycles += (size_t) blocks * DMG_HDMA_BLOCK_CYCLES;
+}
+
+static void write_hdma5(DMGState *state, uint8_t port, uint8_t byte) {
     DMGMmu *mmu = &state->mmu;
+    if (mmu->hdma_hblank && !(byte & 0x80)) {
+        // Stops the HBlank DMA, the blocks left stay readable
+        mmu->hdma_hblank = false;
+        mmu->io[port] |= 0x80;
+        return;
+    }
+    mmu->hdma_source = (uint16_t) (((mmu->io[DMG_IO_HDMA1] << 8) | mmu->io[DMG_IO_HDMA2]) & 0xFFF0);
+    mmu->hdma_dest = (uint16_t) (((mmu->io[DMG_IO_HDMA3] << 8) | mmu->io[DMG_IO_HDMA4]) & 0x1FF0);
+    mmu->hdma_blocks = (uint8_t) ((byte & 0x7F) + 1);
+    // HBlanks the PPU has yet to catch up on came before the transfer
+    sync_ppu(state);
+    if (byte & 0x80) {
+        mmu->hdma_hblank = true;
+        mmu->io[port] = (uint8_t) (byte & 0x7F);
+        // The PPU stops at every HBlank from now on
+        dmg_ppu_reschedule(state);
+        return;
+    }
+    // General purpose: everything at once
+    hdma_copy(state, mmu->hdma_blocks);
+    mmu->hdma_blocks = 0;
+    mmu->io[port] = 0xFF;
+}
+
+static void write_vbk(DMGState *state, uint8_t port, uint8_t byte) {
+    sync_ppu(state);
+    state->mmu.io[port] = byte;
+    unmap(state, 0x8000, 0x9FFF);
+}
+
+static void write_svbk(DMGState *state, uint8_t port, uint8_t byte) {
+    state->mmu.io[port] = byte;
+    state->blocks.dirty = true;
+    state->blocks.epoch++;
+    unmap(state, 0xD000, 0xDFFF);
+    unmap(state, 0xF000, 0xFDFF);
+}
+
+static void write_bios(DMGState *state, uint8_t port, uint8_t byte) {
+    if (state->mmu.io[port] != 0x00) {
+        // The boot ROM cannot be mapped back in
+        return;
+    }
+    state->mmu.io[port] = byte;
+    state->blocks.dirty = true;
+    state->blocks.epoch++;
+    unmap(state, 0x0000, 0x00FF);
+}
+
+/**
+ * Registers with side effects, indexed by DMGIOPort. Everything else is a
+ * plain byte in `io`.
+ */
+static const DMGIORead IO_READS[256] = {
+        [DMG_IO_DIV] = read_div,
+        [DMG_IO_TIMA] = read_tima,
+        [DMG_IO_TAC] = read_tac,
+        [DMG_IO_IF] = read_if,
+        [DMG_IO_STAT] = read_stat,
+        [DMG_IO_LY] = read_ppu,
+        [DMG_IO_HDMA1] = read_write_only,
+        [DMG_IO_HDMA2] = read_write_only,
+        [DMG_IO_HDMA3] = read_write_only,
+        [DMG_IO_HDMA4] = read_write_only,
+};
+
+static const DMGIOWrite IO_WRITES[256] = {
+        [DMG_IO_DIV] = write_timer,
+        [DMG_IO_TIMA] = write_timer,
+        [DMG_IO_TMA] = write_timer,
+        [DMG_IO_TAC] = write_timer,
+        [DMG_IO_IF] = write_interrupts,
+        [DMG_IO_IE] = write_interrupts,
+        [DMG_IO_LCDC] = write_lcdc,
+        [DMG_IO_STAT] = write_stat,
+        [DMG_IO_SCY] = write_ppu,
+        [DMG_IO_SCX] = write_ppu,
+        [DMG_IO_LY] = write_read_only,
+        [DMG_IO_LYC] = write_lyc,
+        [DMG_IO_DMA] = write_dma,
+        [DMG_IO_BGP] = write_ppu,
+        [DMG_IO_OBP0] = write_ppu,
+        [DMG_IO_OBP1] = write_ppu,
+        [DMG_IO_WY] = write_ppu,
+        [DMG_IO_WX] = write_ppu,
+        [DMG_IO_VBK] = write_vbk,
+        [DMG_IO_BIOS] = write_bios,
+        [DMG_IO_HDMA5] = write_hdma5,
+        [DMG_IO_SVBK] = write_svbk,
+};
+
+uint8_t dmg_mmu_read_slow(DMGState *state, uint16_t address) {
+    DMGMmu *mmu = &state->mmu;
+    // IO first, it is most of what gets here
+    if (address >= 0xFF00) {
+        if (address >= 0xFF80 && address != 0xFFFF) {
+            return mmu->hram[address - 0xFF80];
+        }
+        uint8_t port = (uint8_t) address;
+        DMGIORead read = IO_READS[port];
+        return read ? read(state, port) : mmu->io[port];
+    }
+    const uint8_t *memory = memory_at(state, address);
+    if (memory) {
+        // Plain memory on a page that has not been mapped yet
+        state->pages.read[address >> 8] = memory - (address & 0xFF);
+        return *memory;
+    }
+    if (address < 0x0100) {
+        return BIOS[address];
+    } else if (address >= 0xA000 && address <= 0xBFFF) {
+        return dmg_cart_read_ram(state, address);
+    } else if (address <= 0xFE9F) {
+        return mmu->dma ? 0xFF : mmu->oam[address - 0xFE00];
+    }
+    // Unusable
+    return 0xFF;
+}
+
+uint8_t dmg_mmu_read(DMGState *state, uint16_t address) {
+    const uint8_t *page = state->pages.read[address >> 8];
+    if (page) {
+        return page[address & 0xFF];
+    }
+    return dmg_mmu_read_slow(state, address);
+}
+
+static void write_slow(DMGState *state, uint16_t address, uint8_t byte) {
+    DMGMmu *mmu = &state->mmu;
+    // IO first, it is most of what gets here
+    if (address >= 0xFF00) {
+        if (address >= 0xFF80 && address != 0xFFFF) {
+            mmu->hram[address - 0xFF80] = byte;
+            return;
+        }
+        uint8_t port = (uint8_t) address;
+        DMGIOWrite write = IO_WRITES[port];
+        if (write) {
+            write(state, port, byte);
+        } else {
+            mmu->io[port] = byte;
+        }
+        return;
+    }
     switch (address & 0xF000) {
         case 0x8000:
         case 0x9000:
-            mmu->vram[mmu->io[DMG_IO_VBK] & 0x01][address - 0x8000] = byte;
+        {
+            uint8_t bank = mmu->io[DMG_IO_VBK] & 0x01;
+            uint8_t *memory = &mmu->vram[bank][address - 0x8000];
+            if (*memory != byte) {
+                sync_ppu(state);
+                *memory = byte;
+                dmg_ppu_invalidate(state, bank, (uint16_t) (address - 0x8000), 1);
+            }
             break;
+        }
 
         case 0xA000:
         case 0xB000:
-            mmu->cram[address - 0xA000] = byte;
-            break;
-
         case 0xC000:
-            mmu->wram[address - 0xC000] = byte;
-            break;
-
-        case 0xD000:
-            mmu->sram[mmu->io[DMG_IO_SVBK] & 0x07][address - 0xD000] = byte;
+        case 0xD000: {
+            uint8_t *memory = ram_at(state, address);
+            if (!memory) {
+                dmg_cart_write_ram(state, address, byte);
+                break;
+            }
+            // Plain memory on a page that has not been mapped yet
+            state->pages.write[address >> 8] = memory - (address & 0xFF);
+            *memory = byte;
             break;
+        }
 
         case 0xE000:
         case 0xF000:
             if (address <= 0xFDFF) {
+                // Not mapped so that writes to cached code are still seen
                 dmg_mmu_write(state, (uint16_t) (address - 0x2000), byte);
             } else if (address <= 0xFE9F) {
-                mmu->oam[address -  0xFE00] = byte;
-            } else if (address <= 0xFF7F || address == 0xFFFF) {
-                mmu->io[address - 0xFF00] = byte;
-            } else {
-                mmu->hram[address - 0xFF80] = byte;
+                uint8_t *memory = &mmu->oam[address - 0xFE00];
+                if (!mmu->dma && *memory != byte) {
+                    sync_ppu(state);
+                    *memory = byte;
+                    dmg_ppu_invalidate_oam(state);
+                }
             }
+            // 0xFEA0-0xFEFF is unusable
+            break;
 
         default:
+            // ROM, goes to the bank controller
+            dmg_cart_write(state, address, byte);
             break;
     }
 }
+
+void dmg_mmu_write(DMGState *state, uint16_t address, uint8_t byte) {
+    if (state->blocks.code[address >> DMG_BLOCK_LINE_BITS]) {
+        dmg_cpu_invalidate(state, address);
+    }
+    uint8_t *page = state->pages.write[address >> 8];
+    if (page) {
+        page[address & 0xFF] = byte;
+        return;
+    }
+    write_slow(state, address, byte);
+}
+
+void dmg_mmu_dma_event(DMGState *state) {
+    state->mmu.dma = false;
+}
+
+void dmg_mmu_hdma_hblank(DMGState *state) {
+    DMGMmu *mmu = &state->mmu;
+    hdma_copy(state, 1);
+    if (--mmu->hdma_blocks == 0) {
+        mmu->hdma_hblank = false;
+        mmu->io[DMG_IO_HDMA5] = 0xFF;
+    } else {
+        mmu->io[DMG_IO_HDMA5] = (uint8_t) (mmu->hdma_blocks - 1);
+    }
+}
+
+void dmg_mmu_map(DMGState *state, uint16_t start, uint16_t end, const uint8_t *memory) {
+    if (!memory) {
+        unmap(state, start, end);
+        return;
+    }
+    for (size_t page = start >> 8; page <= (size_t) (end >> 8); page++) {
+        state->pages.read[page] = memory + ((page << 8) - start);
+    }
+}
+
+void dmg_mmu_unmap(DMGState *state) {
+    unmap(state, 0x0000, 0xFFFF);
+}
+
+/**
+ * IO as the boot ROM leaves it, in the form `io` keeps it: registers the
+ * PPU, timer or a read handler fills in hold only the bits they do not
+ */
+static const uint8_t POST_BIOS_IO[0x80] = {
+        [DMG_IO_JOYP] = 0xCF,
+        [DMG_IO_SC] = 0x7E,
+        [DMG_IO_IF] = 0x01,
+        [DMG_IO_NR10] = 0x80,
+        [DMG_IO_NR11] = 0xBF,
+        [DMG_IO_NR12] = 0xF3,
+        [DMG_IO_NR13] = 0xFF,
+        [DMG_IO_NR14] = 0xBF,
+        [DMG_IO_NR21] = 0x3F,
+        [DMG_IO_NR23] = 0xFF,
+        [DMG_IO_NR24] = 0xBF,
+        [DMG_IO_NR30] = 0x7F,
+        [DMG_IO_NR31] = 0xFF,
+        [DMG_IO_NR32] = 0x9F,
+        [DMG_IO_NR33] = 0xFF,
+        [DMG_IO_NR34] = 0xBF,
+        [DMG_IO_NR41] = 0xFF,
+        [DMG_IO_NR44] = 0xBF,
+        [DMG_IO_NR50] = 0x77,
+        [DMG_IO_NR51] = 0xF3,
+        [DMG_IO_NR52] = 0xF1,
+        [DMG_IO_DMA] = 0xFF,
+        [DMG_IO_BGP] = 0xFC,
+        [DMG_IO_OBP0] = 0xFF,
+        [DMG_IO_OBP1] = 0xFF,
+        [DMG_IO_BIOS] = 0x01,
+        [DMG_IO_HDMA5] = 0xFF,
+};
+
+// Internal divider when the boot ROM jumps to 0x0100, DIV is its upper byte.
+// The CGB one varies with the header, this is the usual value.
+#define DMG_POST_BIOS_DIV 0xABCC
+#define DMG_POST_BIOS_DIV_CGB 0x1EA0
+
+/**
+ * Doubles each bit of a logo nibble, as the boot ROM scales it up
+ */
+static DMG_INLINE uint8_t scale_nibble(uint8_t nibble) {
+    uint8_t byte = 0x00;
+    for (int bit = 3; bit >= 0; bit--) {
+        byte = (uint8_t) ((byte << 2) | (((nibble >> bit) & 0x01) * 0x03));
+    }
+    return byte;
+}
+
+void dmg_mmu_skip_bios(DMGState *state, bool cgb) {
+    DMGMmu *mmu = &state->mmu;
+    memcpy(mmu->io, POST_BIOS_IO, sizeof(POST_BIOS_IO));
+    if (cgb) {
+        mmu->io[DMG_IO_SC] = 0x7F;
+        mmu->io[DMG_IO_KEY1] = 0x7E;
+        mmu->io[DMG_IO_RP] = 0x3E;
+    }
+    // The divider has been running since power on
+    state->timer.div_base = state->cycles - (cgb ? DMG_POST_BIOS_DIV_CGB : DMG_POST_BIOS_DIV);
+    state->timer.synced = state->cycles;
+
+    if (!cgb && state->rom) {
+        // The logo from the cartridge header at tiles 1-24, scaled up two
+        // times, then the (R) at tile 25 and the map showing them
+        uint8_t *tiles = mmu->vram[0];
+        for (size_t i = 0; i < 48; i++) {
+            uint8_t byte = state->rom[0x0104 + i];
+            uint8_t *rows = &tiles[0x0010 + i * 8];
+            rows[0] = rows[2] = scale_nibble(byte >> 4);
+            rows[4] = rows[6] = scale_nibble(byte & 0x0F);
+        }
+        for (size_t i = 0; i < 8; i++) {
+            tiles[0x0190 + i * 2] = BIOS[0xD8 + i];
+        }
+        for (uint8_t tile = 1; tile <= 12; tile++) {
+            tiles[0x1903 + tile] = tile;
+            tiles[0x1923 + tile] = (uint8_t) (tile + 12);
+        }
+        tiles[0x1910] = 0x19;
+    }
+
+    // Switched on with the background shown, as if it had just been enabled
+    write_lcdc(state, DMG_IO_LCDC, 0x91);
+    dmg_irq_update(state);
+}
@@ -0,0 +1,93 @@
+#include <dmg/pixels.h>
+
+#if defined(DMG_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DMG_PIXELS_X86 1
+#include <immintrin.h>
+#else
+#define DMG_PIXELS_X86 0
+#endif
+
+static void color_scalar(uint32_t *out, const uint8_t *pixels, const uint32_t colors[4], size_t count) {
+    // A local copy, `out` could alias `colors` and force a reload per pixel
+    const uint32_t palette[4] = {colors[0], colors[1], colors[2], colors[3]};
+    size_t x = 0;
+    // Runs of a fixed length the compiler can vectorize on its own
+    for (; x + 8 <= count; x += 8) {
+        for (size_t i = 0; i < 8; i++) {
+            out[x + i] = palette[pixels[x + i]];
+        }
+    }
+    for (; x < count; x++) {
+        out[x] = palette[pixels[x]];
+    }
+}
+
+#if DMG_PIXELS_X86
+
+/**
+ * 16 pixels at a time. SSE2 has no variable shuffle, so each colour number's
+ * two bits become lane masks choosing between the colours with xor blends.
+ */
+__attribute__((target("sse2")))
+static void color_sse2(uint32_t *out, const uint8_t *pixels, const uint32_t colors[4], size_t count) {
+    __m128i bit0 = _mm_set1_epi8(0x01);
+    __m128i bit1 = _mm_set1_epi8(0x02);
+    __m128i c0 = _mm_set1_epi32((int) colors[0]);
+    __m128i c2 = _mm_set1_epi32((int) colors[2]);
+    __m128i c01 = _mm_xor_si128(c0, _mm_set1_epi32((int) colors[1]));
+    __m128i c23 = _mm_xor_si128(c2, _mm_set1_epi32((int) colors[3]));
+    size_t x = 0;
+    for (; x + 16 <= count; x += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *) &pixels[x]);
+        __m128i odd = _mm_cmpeq_epi8(_mm_and_si128(bytes, bit0), bit0);
+        __m128i high = _mm_cmpeq_epi8(_mm_and_si128(bytes, bit1), bit1);
+        // Widen the byte masks to 32 bit lanes, 4 pixels per vector
+        __m128i odd16[2] = {_mm_unpacklo_epi8(odd, odd), _mm_unpackhi_epi8(odd, odd)};
+        __m128i high16[2] = {_mm_unpacklo_epi8(high, high), _mm_unpackhi_epi8(high, high)};
+        for (int q = 0; q < 4; q++) {
+            __m128i m0 = (q & 1) ? _mm_unpackhi_epi16(odd16[q >> 1], odd16[q >> 1]) : _mm_unpacklo_epi16(odd16[q >> 1], odd16[q >> 1]);
+            __m128i m1 = (q & 1) ? _mm_unpackhi_epi16(high16[q >> 1], high16[q >> 1]) : _mm_unpacklo_epi16(high16[q >> 1], high16[q >> 1]);
+            __m128i low = _mm_xor_si128(c0, _mm_and_si128(c01, m0));
+            __m128i up = _mm_xor_si128(c2, _mm_and_si128(c23, m0));
+            __m128i color = _mm_xor_si128(low, _mm_and_si128(_mm_xor_si128(low, up), m1));
+            _mm_storeu_si128((__m128i *) &out[x + q * 4], color);
+        }
+    }
+    color_scalar(&out[x], &pixels[x], colors, count - x);
+}
+
+/**
+ * 8 pixels at a time, the colour numbers widened to 32 bits and used
+ * directly as indices into the palette by a cross-lane permute
+ */
+__attribute__((target("avx2")))
+static void color_avx2(uint32_t *out, const uint8_t *pixels, const uint32_t colors[4], size_t count) {
+    __m256i palette = _mm256_setr_epi32((int) colors[0], (int) colors[1], (int) colors[2], (int) colors[3],
+                                        (int) colors[0], (int) colors[1], (int) colors[2], (int) colors[3]);
+    size_t x = 0;
+    for (; x + 8 <= count; x += 8) {
+        __m256i numbers = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &pixels[x]));
+        _mm256_storeu_si256((__m256i *) &out[x], _mm256_permutevar8x32_epi32(palette, numbers));
+    }
+    // Clean upper halves before any SSE code runs, or every SSE instruction
+    // after this pays for merging them
+    _mm256_zeroupper();
+    color_scalar(&out[x], &pixels[x], colors, count - x);
+}
+
+#endif
+
+void dmg_pixels_color(uint32_t *out, const uint8_t *pixels, const uint32_t colors[4], size_t count) {
+#if DMG_PIXELS_X86
+    // The compiler runtime ran cpuid at startup, this is a load and a test
+    if (__builtin_cpu_supports("avx2")) {
+        color_avx2(out, pixels, colors, count);
+        return;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        color_sse2(out, pixels, colors, count);
+        return;
+    }
+#endif
+    color_scalar(out, pixels, colors, count);
+}
@@ -1,112 +1,401 @@
 #include <dmg/ppu.h>
+#include <dmg/irq.h>
 #include <dmg/mmu.h>
+#include <dmg/sched.h>
 #include <dmg/state.h>
+#include <dmg/pixels.h>
 
-static DMG_INLINE uint8_t bg_palette_for_data(uint8_t data, uint8_t bgp) {
-    switch (data) {
-        case 0x00:
-            return (uint8_t) (bgp & 0x03);
-        case 0x01:
-            return (uint8_t) ((bgp & 0x0C) >> 2);
-        case 0x02:
-            return (uint8_t) ((bgp & 0x30) >> 4);
-        case 0x03:
-            return (uint8_t) ((bgp & 0xC0) >> 6);
-        default:
-            break;
+#include <string.h>
+
+// Length of each mode on a visible line, the rest of the line is HBlank
+#define DMG_PPU_OAM_CYCLES 80
+#define DMG_PPU_DRAW_CYCLES 172
+#define DMG_PPU_LINE_CYCLES 456
+
+// Stands in for the OAM scan on the first line after the LCD is switched on,
+// which STAT shows as HBlank and which raises no interrupt
+#define DMG_PPU_MODE_STARTING 0x04
+
+// Spreads the 8 bits of a tile row plane out to every other bit, so the low
+// and high planes interleave into 2 bits per pixel, leftmost pixel on top
+#define DMG_SPREAD(b) (uint16_t) (((b) & 0x01) | ((b) & 0x02) << 1 | ((b) & 0x04) << 2 | ((b) & 0x08) << 3 | \
+                                  ((b) & 0x10) << 4 | ((b) & 0x20) << 5 | ((b) & 0x40) << 6 | ((b) & 0x80) << 7)
+#define DMG_SPREAD_4(b) DMG_SPREAD(b), DMG_SPREAD((b) + 1), DMG_SPREAD((b) + 2), DMG_SPREAD((b) + 3)
+#define DMG_SPREAD_16(b) DMG_SPREAD_4(b), DMG_SPREAD_4((b) + 4), DMG_SPREAD_4((b) + 8), DMG_SPREAD_4((b) + 12)
+#define DMG_SPREAD_64(b) DMG_SPREAD_16(b), DMG_SPREAD_16((b) + 16), DMG_SPREAD_16((b) + 32), DMG_SPREAD_16((b) + 48)
+
+static const uint16_t INTERLEAVE[256] = {
+        DMG_SPREAD_64(0x00), DMG_SPREAD_64(0x40), DMG_SPREAD_64(0x80), DMG_SPREAD_64(0xC0),
+};
+
+#undef DMG_SPREAD_64
+#undef DMG_SPREAD_16
+#undef DMG_SPREAD_4
+#undef DMG_SPREAD
+
+// Colour of each shade of grey, lightest first
+static const uint32_t SHADES[4] = {0xFFFFFFFF, 0xAAAAAAFF, 0x555555FF, 0x000000FF};
+
+/**
+ * Colour of each of the four 2 bit colour numbers under palette `palette`
+ */
+static DMG_INLINE void palette_colors(uint32_t colors[4], uint8_t palette) {
+    for (int i = 0; i < 4; i++) {
+        colors[i] = SHADES[(palette >> (i * 2)) & 0x03];
+    }
+}
+
+/**
+ * Index of tile `code` in VRAM under LCDC bit 4's addressing mode: tiles
+ * 0-255 from 0x8000, or -128-127 around 0x9000
+ */
+static DMG_INLINE size_t tile_index(bool unsigned_tiles, uint8_t code) {
+    return unsigned_tiles ? code : (size_t) (0x100 + (int8_t) code);
+}
+
+/**
+ * Decodes the tile's 8 rows, interleaving the two planes of each into 2 bits
+ * per pixel and splitting those out left to right
+ */
+static void decode_tile(DMGState *state, uint8_t bank, size_t tile) {
+    const uint8_t *planes = &state->mmu.vram[bank][tile * 16];
+    uint8_t *pixels = state->tiles.pixels[bank][tile];
+    for (int row = 0; row < 8; row++, planes += 2, pixels += 8) {
+        uint16_t bits = (uint16_t) (INTERLEAVE[planes[0]] | (INTERLEAVE[planes[1]] << 1));
+        for (int x = 0; x < 8; x++) {
+            pixels[x] = (uint8_t) ((bits >> (14 - x * 2)) & 0x03);
+        }
+    }
+    state->tiles.valid[bank][tile] = true;
+}
+
+static DMG_INLINE const uint8_t *decoded_tile(DMGState *state, uint8_t bank, size_t tile) {
+    if (!state->tiles.valid[bank][tile]) {
+        decode_tile(state, bank, tile);
+    }
+    return state->tiles.pixels[bank][tile];
+}
+
+/**
+ * Copies the `row` of the tiles in `map` starting at column `column` into
+ * `pixels`, `count` tiles' worth
+ */
+static DMG_INLINE void copy_tiles(DMGState *state, uint8_t *pixels, const uint8_t *map, bool unsigned_tiles,
+                                  int column, int count, uint8_t row) {
+    for (int tile = 0; tile < count; tile++) {
+        uint8_t code = map[(column + tile) & 0x1F];
+        memcpy(&pixels[tile * 8], decoded_tile(state, 0, tile_index(unsigned_tiles, code)) + row * 8, 8);
+    }
+}
+
+/**
+ * Files each sprite under the lines it covers, keeping the first 10 of each
+ * line, then sorts every line into drawing priority
+ */
+static void index_sprites(DMGState *state, bool tall) {
+    DMGSpriteIndex *index = &state->sprites;
+    const uint8_t *oam = state->mmu.oam;
+    int height = tall ? 16 : 8;
+    memset(index->count, 0, sizeof(index->count));
+    for (uint8_t sprite = 0; sprite < sizeof(state->mmu.oam); sprite += 4) {
+        int top = oam[sprite] - 16;
+        for (int ly = top < 0 ? 0 : top; ly < top + height && ly < 144; ly++) {
+            if (index->count[ly] < DMG_PPU_LINE_SPRITES) {
+                index->sprites[ly][index->count[ly]++] = sprite;
+            }
+        }
+    }
+    // Insertion sort on X, stable so that OAM order settles ties
+    for (int ly = 0; ly < 144; ly++) {
+        uint8_t *sprites = index->sprites[ly];
+        for (int i = 1; i < index->count[ly]; i++) {
+            uint8_t sprite = sprites[i];
+            int j = i;
+            for (; j > 0 && oam[sprites[j - 1] + 1] > oam[sprite + 1]; j--) {
+                sprites[j] = sprites[j - 1];
+            }
+            sprites[j] = sprite;
+        }
+    }
+    index->valid = true;
+    index->tall = tall;
+}
+
+/**
+ * Draws the line's sprites over `shades`, the shade of each background pixel
+ * with `line` their colour numbers. Sprites come in priority order, so the
+ * first to put a visible pixel somewhere owns it, even if it is then hidden
+ * behind the background.
+ */
+static DMG_INLINE void draw_sprites(DMGState *state, uint8_t shades[160], const uint8_t *line, uint8_t ly, bool tall) {
+    DMGMmu *mmu = &state->mmu;
+    const DMGSpriteIndex *index = &state->sprites;
+    int height = tall ? 16 : 8;
+    bool taken[160] = {false};
+    for (int i = 0; i < index->count[ly]; i++) {
+        const uint8_t *sprite = &mmu->oam[index->sprites[ly][i]];
+        uint8_t flags = sprite[3];
+        int row = ly - (sprite[0] - 16);
+        if (flags & 0x40) {
+            row = height - 1 - row;
+        }
+        // 8x16 sprites ignore the bottom bit of the tile number
+        size_t tile = (size_t) ((tall ? sprite[2] & 0xFE : sprite[2]) + (row >> 3));
+        const uint8_t *pixels = decoded_tile(state, 0, tile) + (row & 0x07) * 8;
+        uint8_t palette = mmu->io[(flags & 0x10) ? DMG_IO_OBP1 : DMG_IO_OBP0];
+        bool behind = (flags & 0x80) != 0;
+        int left = sprite[1] - 8;
+        for (int x = 0; x < 8; x++) {
+            int screen = left + ((flags & 0x20) ? 7 - x : x);
+            uint8_t color = pixels[x];
+            if (screen < 0 || screen >= 160 || !color || taken[screen]) {
+                continue;
+            }
+            taken[screen] = true;
+            // Behind the background only shows through its colour 0
+            if (!behind || !line[screen]) {
+                shades[screen] = (uint8_t) ((palette >> (color * 2)) & 0x03);
+            }
+        }
+    }
+}
+
+/**
+ * Draws a line a layer at a time. The background and window are copied out of
+ * the tile cache a tile row at a time, and lines without sprites are coloured
+ * straight from their colour numbers. Lines with sprites are worked out as
+ * shades first so that sprites can use their own palettes.
+ *
+ * Always inlined into a kernel per setting of LCDC bits 2-5, which come in as
+ * the constants `tall`, `high_map`, `unsigned_tiles` and `window`.
+ */
+static DMG_INLINE void draw_line(DMGState *state, uint8_t ly, bool tall, bool high_map, bool unsigned_tiles,
+                                 bool window) {
+    DMGPpu *ppu = &state->ppu;
+    DMGMmu *mmu = &state->mmu;
+    uint8_t lcdc = mmu->io[DMG_IO_LCDC];
+    uint8_t scx = mmu->io[DMG_IO_SCX];
+    if (ly == 0) {
+        ppu->window_line = 0;
+    }
+
+    // The 21 background tiles a line can overlap, with 8 pixels spare either
+    // side for a window starting up to 7 left of the screen and running up to
+    // 7 past it
+    uint8_t buffer[8 + 21 * 8 + 8];
+    uint8_t *line = &buffer[8 + (scx & 0x07)];
+    uint8_t palette = mmu->io[DMG_IO_BGP];
+    if (lcdc & 0x01) {
+        uint8_t y = (uint8_t) (ly + mmu->io[DMG_IO_SCY]);
+        const uint8_t *map = &mmu->vram[0][(high_map ? 0x1C00 : 0x1800) + (y >> 3) * 32];
+        copy_tiles(state, &buffer[8], map, unsigned_tiles, scx >> 3, 21, y & 0x07);
+
+        uint8_t wx = mmu->io[DMG_IO_WX];
+        if (window && ly >= mmu->io[DMG_IO_WY] && wx <= 166) {
+            uint8_t wy = ppu->window_line++;
+            map = &mmu->vram[0][((lcdc & 0x40) ? 0x1C00 : 0x1800) + (wy >> 3) * 32];
+            int left = wx - 7;
+            copy_tiles(state, &line[left], map, unsigned_tiles, 0, (160 - left + 7) / 8, wy & 0x07);
+        }
+    } else {
+        // Background and window both blank, white whatever BGP says
+        memset(line, 0, 160);
+        palette = 0x00;
+    }
+
+    uint32_t *lcd = &ppu->lcd[ly * 160];
+    if (lcdc & 0x02) {
+        if (!state->sprites.valid || state->sprites.tall != tall) {
+            index_sprites(state, tall);
+        }
+        if (state->sprites.count[ly]) {
+            uint8_t shades[160];
+            for (int x = 0; x < 160; x++) {
+                shades[x] = (uint8_t) ((palette >> (line[x] * 2)) & 0x03);
+            }
+            draw_sprites(state, shades, line, ly, tall);
+            dmg_pixels_color(lcd, shades, SHADES, 160);
+            return;
+        }
+    }
+    uint32_t colors[4];
+    palette_colors(colors, palette);
+    dmg_pixels_color(lcd, line, colors, 160);
+}
+
+#define DMG_LINE_KERNEL(bits) \
+    static void draw_line_##bits(DMGState *state, uint8_t ly) { \
+        draw_line(state, ly, (bits) & 0x01, (bits) & 0x02, (bits) & 0x04, (bits) & 0x08); \
     }
-    return 0;
-}
-
-static DMG_INLINE uint32_t bg_pixel_at(DMGState *state, uint8_t x, uint8_t y, uint8_t lcdc, uint8_t scx, uint8_t scy, uint8_t bgp) {
-    uint16_t bg_tile_map_table = (uint16_t) ((lcdc & 0x08)? 0x9C00 : 0x9800);
-    uint8_t tile_x = (x + scx) >> 3; // / 8;
-    uint8_t tile_y = (y + scy) >> 3; // / 8
-    uint16_t tile_idx = (tile_y << 5) + tile_x; // * 32 + tile_x
-    uint8_t tile_code = dmg_mmu_read(state, bg_tile_map_table + tile_idx);
-    uint16_t bg_pattern_table = (uint16_t) ((lcdc & 0x10)? (0x8000 + (tile_code * 16)) : 0x9000 + (((int8_t) tile_code) * 16));
-    uint8_t char_x = (uint8_t) ((x + scx) & 0x07); // % 8
-    uint8_t char_y = (uint8_t) (((y + scy) & 0x07) << 1); // % 8 * 2
-    uint8_t bitlow = (uint8_t) ((dmg_mmu_read(state, bg_pattern_table + char_y) & (0x80 >> char_x)) != 0);
-    uint8_t bithigh = (uint8_t) ((dmg_mmu_read(state, (uint16_t) (bg_pattern_table + char_y + 1)) & (0x80 >> char_x)) != 0);
-    switch (bg_palette_for_data((bithigh << 1) | bitlow, bgp)) {
-        case 0x00:
-            return 0xFFFFFFFF;
-        case 0x01:
-            return 0xAAAAAAFF;
+
+DMG_LINE_KERNEL(0) DMG_LINE_KERNEL(1) DMG_LINE_KERNEL(2) DMG_LINE_KERNEL(3)
+DMG_LINE_KERNEL(4) DMG_LINE_KERNEL(5) DMG_LINE_KERNEL(6) DMG_LINE_KERNEL(7)
+DMG_LINE_KERNEL(8) DMG_LINE_KERNEL(9) DMG_LINE_KERNEL(10) DMG_LINE_KERNEL(11)
+DMG_LINE_KERNEL(12) DMG_LINE_KERNEL(13) DMG_LINE_KERNEL(14) DMG_LINE_KERNEL(15)
+
+#undef DMG_LINE_KERNEL
+
+typedef void (*DMGLineKernel)(DMGState *state, uint8_t ly);
+
+// Kernel for each setting of LCDC bits 2-5: sprite size, background map,
+// tile data and window
+static const DMGLineKernel LINE_KERNELS[16] = {
+        draw_line_0, draw_line_1, draw_line_2, draw_line_3, draw_line_4, draw_line_5, draw_line_6, draw_line_7,
+        draw_line_8, draw_line_9, draw_line_10, draw_line_11, draw_line_12, draw_line_13, draw_line_14, draw_line_15,
+};
+
+/**
+ * Draws line `ly` with the kernel for the current LCDC
+ */
+static DMG_INLINE void render_line(DMGState *state, uint8_t ly) {
+    LINE_KERNELS[(state->mmu.io[DMG_IO_LCDC] >> 2) & 0x0F](state, ly);
+}
+
+/**
+ * Works out the mode change that ends the current mode at `*when`: moves
+ * `mode`, `ly` and `when` on to the next one and returns the IF bits it
+ * raises. Shared by the PPU itself and the lookahead for its next interrupt.
+ */
+static DMG_INLINE uint8_t transition(uint8_t *mode, uint8_t *ly, uint64_t *when, uint8_t stat, uint8_t lyc) {
+    switch (*mode) {
         case 0x02:
-            return 0x555555FF;
+        case DMG_PPU_MODE_STARTING:
+            *mode = 0x03;
+            *when += DMG_PPU_DRAW_CYCLES;
+            return 0x00;
+
         case 0x03:
-            return 0x000000FF;
+            *mode = 0x00;
+            *when += DMG_PPU_LINE_CYCLES - DMG_PPU_OAM_CYCLES - DMG_PPU_DRAW_CYCLES;
+            return (uint8_t) ((stat & 0x08) ? 0x02 : 0x00); // stat
+
         default:
+            // End of HBlank or of a VBlank line
+            *ly = (uint8_t) (*ly >= 153 ? 0 : *ly + 1);
             break;
     }
-    return 0x000000FF;
+    uint8_t raised = (uint8_t) ((*ly == lyc && (stat & 0x40)) ? 0x02 : 0x00);
+    if (*ly < 144) {
+        *mode = 0x02;
+        *when += DMG_PPU_OAM_CYCLES;
+        return (uint8_t) (raised | ((stat & 0x20) ? 0x02 : 0x00));
+    }
+    *mode = 0x01;
+    *when += DMG_PPU_LINE_CYCLES;
+    if (*ly == 144) {
+        raised |= 0x01; // vblank
+        raised |= (stat & 0x10) ? 0x02 : 0x00;
+    }
+    return raised;
 }
 
-void dmg_ppu_run(DMGState *state, DMGVBlankCallback vblank, size_t cycles) {
+/**
+ * Applies the mode change due at state->ppu.next
+ */
+static void advance(DMGState *state) {
     DMGPpu *ppu = &state->ppu;
     DMGMmu *mmu = &state->mmu;
-    uint8_t lcdc = mmu->io[DMG_IO_LCDC];
-    if ((lcdc & 0x80) == 0x00) {
-        mmu->io[DMG_IO_LY] = 0x00;
-        mmu->io[DMG_IO_STAT] &= ~0x03;
-        ppu->timer = 456;
-        return;
+    uint8_t stat = mmu->io[DMG_IO_STAT];
+    uint8_t ly = mmu->io[DMG_IO_LY];
+    uint8_t mode = ppu->mode;
+    if (mode == 0x03) {
+        render_line(state, ly);
+    }
+    uint8_t raised = transition(&ppu->mode, &ly, &ppu->next, stat, mmu->io[DMG_IO_LYC]);
+    if (raised) {
+        dmg_irq_raise(state, raised);
+    }
+    mmu->io[DMG_IO_LY] = ly;
+    if (mode == 0x00 || mode == 0x01) {
+        stat = (uint8_t) ((stat & ~0x04) | ((ly == mmu->io[DMG_IO_LYC]) << 2));
+    }
+    mmu->io[DMG_IO_STAT] = (uint8_t) ((stat & ~0x03) | (ppu->mode & 0x03));
+    if (ly == 144 && mode == 0x00 && ppu->vblank) {
+        ppu->vblank(state);
+    }
+    if (ppu->mode == 0x00 && mmu->hdma_hblank) {
+        dmg_mmu_hdma_hblank(state);
     }
+}
+
+/**
+ * Posts DMG_EVENT_PPU for the next mode change that raises an interrupt, or
+ * starts an HBlank during HBlank DMA. The ones before it are left to
+ * dmg_ppu_sync.
+ */
+static void schedule(DMGState *state) {
+    DMGMmu *mmu = &state->mmu;
     uint8_t stat = mmu->io[DMG_IO_STAT];
+    uint8_t lyc = mmu->io[DMG_IO_LYC];
+    uint8_t mode = state->ppu.mode;
     uint8_t ly = mmu->io[DMG_IO_LY];
-    uint8_t mode;
-    if (ly >= 144) {
-        mode = 0x01;
-        ppu->stat_raised = false;
-    } else if (ppu->timer >= 456 - 80) {
-        mode = 0x02;
-        ppu->stat_raised = false;
-    } else if (ppu->timer >= 456 - 80 - 172) {
-        mode = 0x03;
-        ppu->stat_raised = false;
-    } else {
-        mode = 0x00;
-        if (!ppu->stat_raised && (stat & 0x08)) {
-            mmu->io[DMG_IO_IF] |= 0x02; // stat
-            ppu->stat_raised = true;
+    uint64_t when = state->ppu.next;
+    // Terminates within a frame, VBlank always raises one
+    for (;;) {
+        uint64_t due = when;
+        if (transition(&mode, &ly, &when, stat, lyc) || (mode == 0x00 && mmu->hdma_hblank)) {
+            dmg_sched_post(state, DMG_EVENT_PPU, due);
+            return;
         }
     }
-    ppu->timer--;
-    if (ppu->timer == 0) {
-        ppu->timer += 456;
-        ly++;
-        if (ly == 144) {
-            if (!ppu->vblank_raised) {
-                mmu->io[DMG_IO_IF] |= 0x01; // vblank
-                if (stat & 0x10) {
-                    mmu->io[DMG_IO_IF] |= 0x02; // stat
-                }
-                ppu->vblank_raised = true;
-            }
-            vblank(state);
-        } else if (ly > 153) {
-            ppu->vblank_raised = false;
-            ly = 0;
-        }
-        bool coincidence = (ly == mmu->io[DMG_IO_LYC]);
+}
+
+void dmg_ppu_sync(DMGState *state) {
+    if ((state->mmu.io[DMG_IO_LCDC] & 0x80) == 0x00) {
+        return;
+    }
+    while (state->ppu.next <= state->cycles) {
+        advance(state);
+    }
+}
+
+void dmg_ppu_event(DMGState *state, uint64_t when) {
+    dmg_ppu_sync(state);
+    schedule(state);
+}
+
+void dmg_ppu_reschedule(DMGState *state) {
+    if (state->mmu.io[DMG_IO_LCDC] & 0x80) {
+        schedule(state);
+    }
+}
+
+void dmg_ppu_lcd_switched(DMGState *state) {
+    DMGPpu *ppu = &state->ppu;
+    DMGMmu *mmu = &state->mmu;
+    if (mmu->io[DMG_IO_LCDC] & 0x80) {
+        // Line 0 starts straight away, but without an OAM scan or its interrupt
+        uint8_t stat = mmu->io[DMG_IO_STAT];
+        bool coincidence = mmu->io[DMG_IO_LYC] == 0;
+        mmu->io[DMG_IO_LY] = 0x00;
+        mmu->io[DMG_IO_STAT] = (uint8_t) ((stat & ~0x07) | (coincidence << 2));
+        ppu->mode = DMG_PPU_MODE_STARTING;
+        ppu->next = state->cycles + DMG_PPU_OAM_CYCLES;
         if (coincidence && (stat & 0x40)) {
-            mmu->io[DMG_IO_IF] |= 0x02;
-        }
-        stat = (uint8_t) ((stat & ~0x04) | coincidence);
-        if (ly < 144) {
-            if (lcdc & 0x01) {
-                uint8_t scx = mmu->io[DMG_IO_SCX];
-                uint8_t scy = mmu->io[DMG_IO_SCY];
-                uint8_t bgp = mmu->io[DMG_IO_BGP];
-                for (uint8_t x = 0; x < 160; x++) {
-                    ppu->lcd[ly * 160 + x] = bg_pixel_at(state, x, ly, lcdc, scx, scy, bgp);
-                }
-            }
+            dmg_irq_raise(state, DMG_INT_STAT);
         }
+        schedule(state);
+    } else {
+        dmg_sched_cancel(state, DMG_EVENT_PPU);
+        mmu->io[DMG_IO_LY] = 0x00;
+        mmu->io[DMG_IO_STAT] &= ~0x03;
+        ppu->mode = 0x00;
     }
-    stat = (uint8_t) ((stat & ~0x03) | mode);
-    mmu->io[DMG_IO_LY] = ly;
-    mmu->io[DMG_IO_STAT] = stat;
-}
\ No newline at end of file
+}
+
+void dmg_ppu_invalidate(DMGState *state, uint8_t bank, uint16_t offset, uint16_t length) {
+    // Only the first 0x1800 bytes are tiles, the maps follow
+    size_t end = (size_t) offset + length;
+    for (size_t tile = offset / 16; tile < DMG_PPU_TILES && tile * 16 < end; tile++) {
+        state->tiles.valid[bank][tile] = false;
+    }
+}
+
+void dmg_ppu_invalidate_oam(DMGState *state) {
+    state->sprites.valid = false;
+}
+
+void dmg_ppu_invalidate_all(DMGState *state) {
+    memset(state->tiles.valid, 0, sizeof(state->tiles.valid));
+    state->sprites.valid = false;
+}
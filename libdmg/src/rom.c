@@ -0,0 +1,99 @@
+#include <dmg/rom.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DMG_ROM_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define DMG_ROM_MMAP 0
+#endif
+
+bool dmg_rom_valid(const uint8_t *data, size_t size) {
+    if (size < 0x8000) {
+        return false;
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 0x0134; i <= 0x014C; i++) {
+        checksum = (uint8_t) (checksum - data[i] - 1);
+    }
+    if (checksum != data[0x014D]) {
+        return false;
+    }
+    return data[0x0148] <= 0x08 && ((size_t) 0x8000 << data[0x0148]) <= size;
+}
+
+#if DMG_ROM_MMAP
+
+bool dmg_rom_open(DMGRom *rom, const char *path) {
+    memset(rom, 0, sizeof(DMGRom));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 0x8000) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t) st.st_size;
+    // Shared and read-only, so every instance is backed by the page cache
+    void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps the file open on its own
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    if (!dmg_rom_valid(data, size)) {
+        munmap(data, size);
+        return false;
+    }
+    rom->data = data;
+    rom->size = size;
+    rom->mapped = true;
+    return true;
+}
+
+#else
+
+bool dmg_rom_open(DMGRom *rom, const char *path) {
+    memset(rom, 0, sizeof(DMGRom));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    uint8_t *data = length > 0 ? malloc((size_t) length) : NULL;
+    bool read = data && fread(data, 1, (size_t) length, file) == (size_t) length;
+    fclose(file);
+    if (!read || !dmg_rom_valid(data, (size_t) length)) {
+        free(data);
+        return false;
+    }
+    rom->data = data;
+    rom->size = (size_t) length;
+    return true;
+}
+
+#endif
+
+void dmg_rom_close(DMGRom *rom) {
+    if (!rom->data) {
+        return;
+    }
+#if DMG_ROM_MMAP
+    if (rom->mapped) {
+        munmap((void *) rom->data, rom->size);
+    }
+#else
+    free((void *) rom->data);
+#endif
+    memset(rom, 0, sizeof(DMGRom));
+}
@@ -0,0 +1,104 @@
+#include <dmg/save.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define DMG_SAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define DMG_SAVE_MMAP 0
+#endif
+
+#if DMG_SAVE_MMAP
+
+bool dmg_save_open(DMGSave *save, const char *path, size_t size) {
+    memset(save, 0, sizeof(DMGSave));
+    if (!size) {
+        return false;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t) st.st_size < size && ftruncate(fd, (off_t) size) != 0)) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    save->data = data;
+    save->size = size;
+    save->mapped = true;
+    return true;
+}
+
+#else
+
+bool dmg_save_open(DMGSave *save, const char *path, size_t size) {
+    memset(save, 0, sizeof(DMGSave));
+    if (!size) {
+        return false;
+    }
+    save->data = calloc(1, size);
+    save->path = malloc(strlen(path) + 1);
+    if (!save->data || !save->path) {
+        free(save->data);
+        free(save->path);
+        memset(save, 0, sizeof(DMGSave));
+        return false;
+    }
+    strcpy(save->path, path);
+    save->size = size;
+    FILE *file = fopen(path, "rb");
+    if (file) {
+        fread(save->data, 1, size, file);
+        fclose(file);
+    }
+    return true;
+}
+
+#endif
+
+void dmg_save_flush(DMGSave *save) {
+    if (!save->data) {
+        return;
+    }
+#if DMG_SAVE_MMAP
+    if (save->mapped) {
+        msync(save->data, save->size, MS_ASYNC);
+        return;
+    }
+#endif
+    FILE *file = fopen(save->path, "wb");
+    if (file) {
+        fwrite(save->data, 1, save->size, file);
+        fclose(file);
+    }
+}
+
+void dmg_save_close(DMGSave *save) {
+    if (!save->data) {
+        return;
+    }
+#if DMG_SAVE_MMAP
+    if (save->mapped) {
+        msync(save->data, save->size, MS_SYNC);
+        munmap(save->data, save->size);
+        memset(save, 0, sizeof(DMGSave));
+        return;
+    }
+#endif
+    dmg_save_flush(save);
+    free(save->data);
+    free(save->path);
+    memset(save, 0, sizeof(DMGSave));
+}
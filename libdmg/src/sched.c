@@ -0,0 +1,112 @@
+#include <dmg/sched.h>
+#include <dmg/mmu.h>
+#include <dmg/ppu.h>
+#include <dmg/state.h>
+#include <dmg/timer.h>
+
+_Static_assert(DMG_EVENT_COUNT <= DMG_SCHED_CAPACITY, "DMG_SCHED_CAPACITY too small for every event type");
+
+static DMG_INLINE bool earlier(DMGScheduler *sched, size_t i, size_t j) {
+    return sched->when[sched->heap[i]] < sched->when[sched->heap[j]];
+}
+
+static DMG_INLINE void swap(DMGScheduler *sched, size_t i, size_t j) {
+    uint8_t tmp = sched->heap[i];
+    sched->heap[i] = sched->heap[j];
+    sched->heap[j] = tmp;
+    sched->index[sched->heap[i]] = (uint8_t) i;
+    sched->index[sched->heap[j]] = (uint8_t) j;
+}
+
+static void sift_up(DMGScheduler *sched, size_t i) {
+    while (i > 0 && earlier(sched, i, (i - 1) / 2)) {
+        swap(sched, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static void sift_down(DMGScheduler *sched, size_t i) {
+    for (;;) {
+        size_t min = i;
+        size_t left = 2 * i + 1;
+        size_t right = left + 1;
+        if (left < sched->size && earlier(sched, left, min)) {
+            min = left;
+        }
+        if (right < sched->size && earlier(sched, right, min)) {
+            min = right;
+        }
+        if (min == i) {
+            return;
+        }
+        swap(sched, i, min);
+        i = min;
+    }
+}
+
+static DMG_INLINE bool pending(DMGScheduler *sched, DMGEventType type) {
+    uint8_t i = sched->index[type];
+    return i < sched->size && sched->heap[i] == type;
+}
+
+static void remove_at(DMGScheduler *sched, size_t i) {
+    sched->size--;
+    if (i == sched->size) {
+        return;
+    }
+    swap(sched, i, sched->size);
+    sift_up(sched, i);
+    sift_down(sched, i);
+}
+
+void dmg_sched_post(DMGState *state, DMGEventType type, uint64_t when) {
+    DMGScheduler *sched = &state->sched;
+    sched->when[type] = when;
+    if (pending(sched, type)) {
+        sift_up(sched, sched->index[type]);
+        sift_down(sched, sched->index[type]);
+    } else {
+        sched->heap[sched->size] = (uint8_t) type;
+        sched->index[type] = sched->size;
+        sift_up(sched, sched->size++);
+    }
+    if (when < sched->deadline) {
+        // Posted from inside the CPU, e.g. by an IO write
+        sched->deadline = when;
+        state->blocks.dirty = true;
+    }
+}
+
+void dmg_sched_cancel(DMGState *state, DMGEventType type) {
+    DMGScheduler *sched = &state->sched;
+    if (pending(sched, type)) {
+        remove_at(sched, sched->index[type]);
+    }
+}
+
+uint64_t dmg_sched_next(DMGState *state) {
+    DMGScheduler *sched = &state->sched;
+    return sched->size ? sched->when[sched->heap[0]] : UINT64_MAX;
+}
+
+void dmg_sched_dispatch(DMGState *state) {
+    DMGScheduler *sched = &state->sched;
+    while (sched->size && sched->when[sched->heap[0]] <= state->cycles) {
+        DMGEventType type = (DMGEventType) sched->heap[0];
+        uint64_t when = sched->when[type];
+        remove_at(sched, 0);
+        switch (type) {
+            case DMG_EVENT_PPU:
+                dmg_ppu_event(state, when);
+                break;
+            case DMG_EVENT_DMA:
+                dmg_mmu_dma_event(state);
+                break;
+            case DMG_EVENT_TIMER:
+                dmg_timer_event(state);
+                break;
+            default:
+                assert(false);
+        }
+    }
+}
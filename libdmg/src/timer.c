@@ -0,0 +1,89 @@
+#include <dmg/timer.h>
+#include <dmg/irq.h>
+#include <dmg/mmu.h>
+#include <dmg/sched.h>
+#include <dmg/state.h>
+
+// Cycles per TIMA increment for each TAC clock select
+static const uint64_t PERIODS[4] = {1024, 16, 64, 256};
+
+static DMG_INLINE bool enabled(DMGState *state) {
+    return (state->mmu.io[DMG_IO_TAC] & 0x04) != 0;
+}
+
+static DMG_INLINE uint64_t period(DMGState *state) {
+    return PERIODS[state->mmu.io[DMG_IO_TAC] & 0x03];
+}
+
+/**
+ * TIMA increments when the divider bit TAC selects falls, i.e. whenever the
+ * divider passes a multiple of the period. Returns the first such cycle
+ * after `cycles`.
+ */
+static DMG_INLINE uint64_t next_tick(DMGState *state, uint64_t cycles) {
+    uint64_t base = state->timer.div_base;
+    uint64_t p = period(state);
+    return base + ((cycles - base) / p + 1) * p;
+}
+
+/**
+ * Posts DMG_EVENT_TIMER for the next TIMA overflow
+ */
+static void schedule(DMGState *state) {
+    if (!enabled(state)) {
+        dmg_sched_cancel(state, DMG_EVENT_TIMER);
+        return;
+    }
+    uint64_t increments = 0x100u - state->mmu.io[DMG_IO_TIMA];
+    uint64_t when = next_tick(state, state->cycles) + (increments - 1) * period(state);
+    dmg_sched_post(state, DMG_EVENT_TIMER, when);
+}
+
+uint8_t dmg_timer_div(DMGState *state) {
+    return (uint8_t) ((state->cycles - state->timer.div_base) >> 8);
+}
+
+void dmg_timer_sync(DMGState *state) {
+    DMGTimer *timer = &state->timer;
+    DMGMmu *mmu = &state->mmu;
+    if (enabled(state) && state->cycles > timer->synced) {
+        uint64_t base = timer->div_base;
+        uint64_t p = period(state);
+        uint64_t increments = (state->cycles - base) / p - (timer->synced - base) / p;
+        uint64_t left = 0x100u - mmu->io[DMG_IO_TIMA];
+        if (increments < left) {
+            mmu->io[DMG_IO_TIMA] = (uint8_t) (mmu->io[DMG_IO_TIMA] + increments);
+        } else {
+            // Overflowed, possibly more than once if nobody looked for a while
+            uint64_t span = 0x100u - mmu->io[DMG_IO_TMA];
+            mmu->io[DMG_IO_TIMA] = (uint8_t) (mmu->io[DMG_IO_TMA] + (increments - left) % span);
+            dmg_irq_raise(state, DMG_INT_TIMER);
+        }
+    }
+    timer->synced = state->cycles;
+}
+
+void dmg_timer_event(DMGState *state) {
+    dmg_timer_sync(state);
+    schedule(state);
+}
+
+void dmg_timer_write(DMGState *state, uint8_t port, uint8_t byte) {
+    // Increments so far count under the old settings
+    dmg_timer_sync(state);
+    if (port == DMG_IO_DIV) {
+        // Any write resets the divider, moving the TIMA phase with it
+        state->timer.div_base = state->cycles;
+    } else {
+        state->mmu.io[port] = port == DMG_IO_TAC ? (uint8_t) (byte & 0x07) : byte;
+    }
+    schedule(state);
+}
+
+uint64_t dmg_timer_next_change(DMGState *state, uint8_t port) {
+    if (port == DMG_IO_DIV) {
+        uint64_t base = state->timer.div_base;
+        return base + ((state->cycles - base) / 256 + 1) * 256;
+    }
+    return enabled(state) ? next_tick(state, state->cycles) : UINT64_MAX;
+}